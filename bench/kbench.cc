@@ -0,0 +1,198 @@
+// Benchmark del throughput del compilatore: per ogni file misura
+// separatamente scanner, parser, driver::codegen ed emissione del codice
+// oggetto, e scrive i risultati in JSON. Con --baseline confronta i
+// throughput con quelli di un'esecuzione precedente.
+//   kbench [-o risultati.json] [--baseline base.json] [--tolerance 0.15]
+//          [--repeat N] file.k ...
+// Ogni fase viene ripetuta N volte (default 3) e si tiene il tempo migliore.
+// Il tempo del parser è quello del parsing meno quello del solo scanner.
+#include <chrono>
+#include "driver.hh"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double since(Clock::time_point Start) {
+  return std::chrono::duration<double>(Clock::now() - Start).count();
+}
+
+struct Result {
+  std::string Name;
+  uint64_t Bytes = 0;
+  size_t Tokens = 0, Nodes = 0, Instructions = 0, ObjectBytes = 0;
+  double Scan = 1e30, Parse = 1e30, Codegen = 1e30, Emit = 1e30;
+};
+
+static bool measure(const Target *T, const std::string &Triple, const std::string &File,
+                    unsigned Repeat, Result &R) {
+  R.Name = std::string(sys::path::filename(File));
+  sys::fs::file_size(File, R.Bytes);
+  for (unsigned Run = 0; Run < Repeat; ++Run) {
+    {
+      driver drv;
+      auto Start = Clock::now();
+      if (drv.scan(File, R.Tokens))
+        return true;
+      R.Scan = std::min(R.Scan, since(Start));
+    }
+    std::unique_ptr<TargetMachine> TM(
+        T->createTargetMachine(Triple, "generic", "", TargetOptions(), None));
+    driver drv;
+    drv.module->setDataLayout(TM->createDataLayout());
+    drv.module->setTargetTriple(Triple);
+    auto Start = Clock::now();
+    if (drv.parse(File)) {
+      errs() << File << ": errore di parsing\n";
+      return true;
+    }
+    R.Parse = std::min(R.Parse, since(Start));
+    R.Nodes = drv.arena.total();
+    Start = Clock::now();
+    drv.codegen();
+    R.Codegen = std::min(R.Codegen, since(Start));
+    R.Instructions = drv.module->getInstructionCount();
+    SmallVector<char, 0> Obj;
+    raw_svector_ostream dest(Obj);
+    legacy::PassManager pass;
+    if (TM->addPassesToEmitFile(pass, dest, nullptr, CGFT_ObjectFile)) {
+      errs() << "TheTargetMachine can't emit a file of this type";
+      return true;
+    }
+    Start = Clock::now();
+    pass.run(*drv.module);
+    R.Emit = std::min(R.Emit, since(Start));
+    R.ObjectBytes = Obj.size();
+  }
+  R.Parse = std::max(R.Parse - R.Scan, 1e-9);
+  return false;
+}
+
+static json::Object toJSON(const Result &R) {
+  return json::Object{
+    {"name", R.Name},
+    {"bytes", (int64_t)R.Bytes},
+    {"tokens", (int64_t)R.Tokens},
+    {"nodes", (int64_t)R.Nodes},
+    {"instructions", (int64_t)R.Instructions},
+    {"object_bytes", (int64_t)R.ObjectBytes},
+    {"scan_s", R.Scan},
+    {"parse_s", R.Parse},
+    {"codegen_s", R.Codegen},
+    {"emit_s", R.Emit},
+    {"tokens_per_s", R.Tokens / R.Scan},
+    {"nodes_per_s", R.Nodes / R.Parse},
+    {"instructions_per_s", R.Instructions / R.Codegen},
+    {"emit_instructions_per_s", R.Instructions / R.Emit},
+  };
+}
+
+// Confronta i throughput con la baseline: restituisce true se almeno uno
+// è peggiorato oltre la tolleranza
+static bool compare(const json::Array &Files, const std::string &Baseline, double Tolerance) {
+  auto Buf = MemoryBuffer::getFile(Baseline);
+  if (!Buf) {
+    errs() << "Impossibile leggere " << Baseline << ": " << Buf.getError().message() << "\n";
+    return true;
+  }
+  Expected<json::Value> Base = json::parse((*Buf)->getBuffer());
+  if (!Base) {
+    logAllUnhandledErrors(Base.takeError(), errs(), Baseline + ": ");
+    return true;
+  }
+  StringMap<const json::Object *> ByName;
+  if (const json::Object *Root = Base->getAsObject())
+    if (const json::Array *BF = Root->getArray("files"))
+      for (const json::Value &V : *BF)
+        if (const json::Object *O = V.getAsObject())
+          if (auto Name = O->getString("name"))
+            ByName[*Name] = O;
+
+  static const char *Metrics[] = { "tokens_per_s", "nodes_per_s", "instructions_per_s",
+                                   "emit_instructions_per_s" };
+  bool Regression = false;
+  outs() << "Confronto con " << Baseline << " (tolleranza "
+         << format("%.0f", Tolerance * 100) << "%)\n";
+  for (const json::Value &V : Files) {
+    const json::Object *Cur = V.getAsObject();
+    StringRef Name = *Cur->getString("name");
+    auto It = ByName.find(Name);
+    if (It == ByName.end()) {
+      outs() << "  " << Name << ": assente nella baseline\n";
+      continue;
+    }
+    for (const char *M : Metrics) {
+      Optional<double> Old = It->second->getNumber(M), New = Cur->getNumber(M);
+      if (!Old || !New || *Old <= 0)
+        continue;
+      double Ratio = *New / *Old;
+      bool Worse = Ratio < 1 - Tolerance;
+      Regression |= Worse;
+      outs() << "  " << left_justify(Name, 16) << left_justify(M, 26)
+             << format("%8.2fx", Ratio) << (Worse ? "  REGRESSIONE" : "") << "\n";
+    }
+  }
+  return Regression;
+}
+
+int main(int argc, char *argv[]) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  std::string Output = "", Baseline = "";
+  double Tolerance = 0.15;
+  unsigned Repeat = 3;
+  std::vector<std::string> Files;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i] == std::string("-o") && i + 1 < argc)
+      Output = argv[++i];
+    else if (argv[i] == std::string("--baseline") && i + 1 < argc)
+      Baseline = argv[++i];
+    else if (argv[i] == std::string("--tolerance") && i + 1 < argc)
+      Tolerance = atof(argv[++i]);
+    else if (argv[i] == std::string("--repeat") && i + 1 < argc)
+      Repeat = std::max(1, atoi(argv[++i]));
+    else
+      Files.push_back(argv[i]);
+  }
+
+  auto Triple = sys::getDefaultTargetTriple();
+  std::string Error;
+  auto T = TargetRegistry::lookupTarget(Triple, Error);
+  if (!T) {
+    errs() << Error;
+    return 1;
+  }
+
+  json::Array Results;
+  for (auto &File : Files) {
+    Result R;
+    if (measure(T, Triple, File, Repeat, R))
+      return 1;
+    outs() << left_justify(R.Name, 16)
+           << format("%12.0f token/s %12.0f nodi/s %12.0f istr/s (codegen) %12.0f istr/s (emissione)\n",
+                     R.Tokens / R.Scan, R.Nodes / R.Parse, R.Instructions / R.Codegen,
+                     R.Instructions / R.Emit);
+    Results.push_back(toJSON(R));
+  }
+
+  json::Value Report = json::Object{
+    {"triple", Triple},
+    {"repeat", (int64_t)Repeat},
+    {"files", std::move(Results)},
+  };
+  if (Output != "") {
+    std::error_code EC;
+    raw_fd_ostream dest(Output, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "Could not open file: " << EC.message();
+      return 1;
+    }
+    dest << formatv("{0:2}", Report) << "\n";
+    outs() << "Wrote " << Output << "\n";
+  }
+  if (Baseline != "" && compare(*Report.getAsObject()->getArray("files"), Baseline, Tolerance))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,123 @@
+// Generatore deterministico di programmi Kaleidoscope per i benchmark.
+//   kgen <asse> <dimensione> [seme]
+// Assi:
+//   functions  molte funzioni, ognuna chiama la precedente
+//   nesting    espressioni annidate fino alla profondità indicata
+//   seq        lunghe sequenze di espressioni separate da ':'
+//   vars       liste "var" con molti binding
+//   loops      "for"/"while" annidati fino alla profondità indicata
+//   mixed      un po' di tutto, in proporzione alla dimensione
+// A parità di argomenti l'output è sempre lo stesso (nessuna dipendenza
+// dalla piattaforma o dalla libreria standard).
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Generatore congruenziale lineare (costanti di Knuth, MMIX). Ogni valore
+// viene estratto in un'istruzione a sé: l'ordine di valutazione degli
+// argomenti di una chiamata non è specificato e renderebbe l'output
+// dipendente dal compilatore
+static uint64_t State;
+static unsigned next(unsigned n) {
+  State = State * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (unsigned)(State >> 33) % n;
+}
+
+static const char *Ops[] = { "+", "-", "*", "/" };
+
+static void functions(unsigned n) {
+  printf("def f0(x y) x + y;\n");
+  for (unsigned i = 1; i < n; i++) {
+    const char *Op = Ops[next(4)];
+    unsigned A = next(100) + 1;
+    unsigned B = next(100) + 1;
+    printf("def f%u(x y) f%u(x, y) %s x * %u - y / %u;\n", i, i - 1, Op, A, B);
+  }
+}
+
+static void nesting(unsigned n) {
+  std::vector<bool> Ifs; // Livelli aperti da un if, da chiudere con "end"
+  printf("def deep(x) ");
+  for (unsigned i = 0; i < n; i++) {
+    Ifs.push_back(next(4) == 0);
+    if (Ifs.back())
+      printf("if x < %u then x else (", next(1000));
+    else
+      printf("(");
+  }
+  printf("x");
+  for (unsigned i = n; i-- > 0;) {
+    const char *Op = Ops[next(4)];
+    printf(Ifs[i] ? " %s %u) end" : " %s %u)", Op, next(100) + 1);
+  }
+  printf(";\n");
+}
+
+static void seq(unsigned n) {
+  printf("def seq(x) var a = x in ");
+  for (unsigned i = 0; i < n; i++) {
+    const char *Op = Ops[next(4)];
+    printf("a = a %s %u : ", Op, next(100) + 1);
+  }
+  printf("a end;\n");
+}
+
+static void vars(unsigned n) {
+  printf("def vars(x) var v0 = x");
+  for (unsigned i = 1; i < n; i++) {
+    unsigned Prev = next(i);
+    const char *Op = Ops[next(4)];
+    printf(", v%u = v%u %s %u", i, Prev, Op, next(100) + 1);
+  }
+  printf(" in v%u end;\n", n - 1);
+}
+
+static void loops(unsigned n) {
+  printf("def loops(x) var s = 0 in ");
+  for (unsigned i = 0; i < n; i++) {
+    if (i % 2)
+      printf("var w%u = 0 in while w%u < %u in w%u = w%u + 1 : ", i, i, next(4) + 1, i, i);
+    else
+      printf("for i%u = 0, i%u < %u in ", i, i, next(4) + 1);
+  }
+  printf("s = s + x");
+  for (unsigned i = n; i-- > 0;)
+    printf(i % 2 ? " end end" : " end");
+  printf(" : s end;\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "uso: %s functions|nesting|seq|vars|loops|mixed <dimensione> [seme]\n",
+            argv[0]);
+    return 1;
+  }
+  std::string Axis = argv[1];
+  unsigned N = std::max(1, atoi(argv[2]));
+  State = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+  if (Axis == "functions")
+    functions(N);
+  else if (Axis == "nesting")
+    nesting(N);
+  else if (Axis == "seq")
+    seq(N);
+  else if (Axis == "vars")
+    vars(N);
+  else if (Axis == "loops")
+    loops(N);
+  else if (Axis == "mixed") {
+    functions(N);
+    nesting(N / 10 + 1);
+    seq(N);
+    vars(N);
+    loops(N / 100 + 2);
+  } else {
+    fprintf(stderr, "asse sconosciuto: %s\n", Axis.c_str());
+    return 1;
+  }
+  return 0;
+}
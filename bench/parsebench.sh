@@ -0,0 +1,27 @@
+#!/bin/sh
+# Benchmark del parser: genera un file con molti elementi top-level e
+# chiamate con migliaia di argomenti, e ne misura il solo parsing.
+#   bench/parsebench.sh [elementi top-level] [argomenti per chiamata]
+KFE=${KFE:-./kfe}
+N=${1:-100000}
+A=${2:-5000}
+SRC=${TMPDIR:-/tmp}/parsebench.k
+
+awk -v n="$N" -v a="$A" 'BEGIN {
+  printf "def wide("
+  for (j = 0; j < a; j++) printf " a%d", j
+  printf ") a0;\n"
+  for (i = 0; i < n; i++) {
+    if (i % 1000 == 0) {
+      printf "wide("
+      for (j = 0; j < a; j++) printf (j ? ", %d" : "%d"), j
+      printf ");\n"
+    } else
+      printf "def f%d(x y) x * y + %d;\n", i, i
+  }
+}' > "$SRC"
+
+for run in 1 2 3; do
+  $KFE --parse-only "$SRC"
+done
+rm -f "$SRC"
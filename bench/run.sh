@@ -0,0 +1,28 @@
+#!/bin/sh
+# Suite di benchmark del throughput (make bench): genera con kgen un
+# programma per ogni asse e misura con kbench scanner, parser, codegen ed
+# emissione. I risultati vanno in bench/results.json; se esiste
+# bench/baseline.json (o il file indicato in $BASELINE) vengono confrontati.
+#   bench/run.sh [scala]
+# Per salvare una nuova baseline: cp bench/results.json bench/baseline.json
+DIR=$(dirname "$0")
+S=${1:-1}
+BASELINE=${BASELINE:-$DIR/baseline.json}
+TMP=${TMPDIR:-/tmp}/kbench.$$
+mkdir -p "$TMP"
+
+"$DIR/kgen" functions $((1000 * S)) > "$TMP/functions.k"
+"$DIR/kgen" nesting   $((1000 * S)) > "$TMP/nesting.k"
+"$DIR/kgen" seq       $((5000 * S)) > "$TMP/seq.k"
+"$DIR/kgen" vars      $((5000 * S)) > "$TMP/vars.k"
+"$DIR/kgen" loops     $((100 * S)) > "$TMP/loops.k"
+"$DIR/kgen" mixed     $((1000 * S)) > "$TMP/mixed.k"
+
+if [ -f "$BASELINE" ]; then
+  "$DIR/kbench" -o "$DIR/results.json" --baseline "$BASELINE" "$TMP"/*.k
+else
+  "$DIR/kbench" -o "$DIR/results.json" "$TMP"/*.k
+fi
+res=$?
+rm -rf "$TMP"
+exit $res
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Benchmark dello scanner: misura il throughput (MB/s) dell'analisi lessicale
+# su un file .k sintetico di grandi dimensioni, confrontando la lettura
+# tramite stdio (yyin) con l'input mappato in memoria (yy_scan_buffer).
+#   bench/scanbench.sh [numero di definizioni]
+KFE=${KFE:-./kfe}
+N=${1:-200000}
+SRC=${TMPDIR:-/tmp}/scanbench.k
+
+awk -v n="$N" 'BEGIN {
+  for (i = 0; i < n; i++)
+    printf "def f%d(x y) var a = x * %d.5 in for i = 0, i < y in a = a + i * x end end;\n", i, i
+}' > "$SRC"
+
+for run in 1 2 3; do
+  $KFE --stdio-input --scan-only "$SRC"
+  $KFE --scan-only "$SRC"
+done
+rm -f "$SRC"
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Benchmark della tabella dei simboli: genera funzioni con centinaia di
+# binding "var" e scope "for"/"var" profondamente annidati e confronta il
+# tempo di compilazione (parsing + codegen) dello stesso sorgente con la
+# ScopedSymbolTable e con la std::map NamedValues che ha sostituito.
+# Di default i due kfe vengono compilati in worktree temporanei: NEW è il
+# commit che ha introdotto la tabella (e questo script), BASE il suo
+# genitore; KFE e BASE_KFE indicano invece due eseguibili già compilati.
+#   bench/scopebench.sh [funzioni] [variabili per funzione] [profondità]
+DIR=$(cd "$(dirname "$0")/.." && pwd)
+F=${1:-200}
+V=${2:-500}
+D=${3:-200}
+TMP=${TMPDIR:-/tmp}/scopebench.$$
+SRC=$TMP/scopebench.k
+mkdir -p "$TMP"
+
+cleanup() {
+  for w in "$TMP/new" "$TMP/base"; do
+    [ -d "$w" ] && git -C "$DIR" worktree remove --force "$w"
+  done
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+# build <revisione> <directory>: kfe della revisione, compilato in un worktree
+build() {
+  if ! git -C "$DIR" worktree add -q --detach "$2" "$1" ||
+     ! make -C "$2" kfe > "$2.log" 2>&1; then
+    echo "scopebench: compilazione di $1 fallita" >&2
+    tail -n 5 "$2.log" >&2
+    exit 1
+  fi
+}
+
+if [ -z "$KFE" ] || [ -z "$BASE_KFE" ]; then
+  NEW=${NEW:-$(git -C "$DIR" log --diff-filter=A --format=%H -- bench/scopebench.sh | tail -n 1)}
+  BASE=${BASE:-$NEW^}
+  build "$NEW" "$TMP/new"
+  build "$BASE" "$TMP/base"
+  KFE=$TMP/new/kfe
+  BASE_KFE=$TMP/base/kfe
+fi
+
+awk -v f="$F" -v v="$V" -v d="$D" 'BEGIN {
+  for (i = 0; i < f; i++) {
+    # Molti binding in un solo var
+    printf "def wide%d(x) var v0 = x", i
+    for (j = 1; j < v; j++) printf ", v%d = v%d + %d", j, j - 1, j
+    printf " in v%d end;\n", v - 1
+    # Scope annidati, con oscuramento dello stesso nome
+    printf "def deep%d(x) ", i
+    for (j = 0; j < d; j++)
+      printf (j % 2 ? "var x = x + 1 in " : "for k = 0, k < x in ")
+    printf "x"
+    for (j = 0; j < d; j++) printf " end"
+    printf ";\n"
+  }
+}' > "$SRC"
+
+# best <kfe>: il migliore di tre tempi di compilazione, in ms
+best() {
+  b=
+  for run in 1 2 3; do
+    start=$(date +%s%N)
+    "$1" "$SRC" > /dev/null 2>&1
+    end=$(date +%s%N)
+    t=$(( (end - start) / 1000000 ))
+    if [ -z "$b" ] || [ "$t" -lt "$b" ]; then b=$t; fi
+  done
+  echo "$b"
+}
+
+base=$(best "$BASE_KFE")
+new=$(best "$KFE")
+echo "scopebench: std::map $base ms, ScopedSymbolTable $new ms" \
+     "($(awk -v b="$base" -v n="$new" 'BEGIN { printf "%.2f", n ? b / n : 0 }')x)"
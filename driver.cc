@@ -1,7 +1,12 @@
 #include "driver.hh"
 #include "parser.hh"
-#include "llvm/Support/raw_os_ostream.h"
 #include <typeinfo>
+#include <cstring>
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Analysis/VectorUtils.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/IR/InstIterator.h"
+#include "runtime/kfe_runtime.h"
 
 Value *LogErrorV(const std::string Str) {
   std::cerr << Str << std::endl;
@@ -12,22 +17,326 @@ Value *LogErrorV(const std::string Str) {
 // Funzione per gestire le allocazioni, crea un blocco apposito per esse
 // CreateEntryBlockAlloca - Crea un'istruzione "alloca" nel blocco di ingresso della funzione.
 // Questo è usato per variabili mutabili, iteratori nei for, ecc...
-static AllocaInst *CreateEntryBlockAlloca(driver &drv, Function *TheFunction, const std::string &VarName, Value *arraySize = nullptr) {
+static AllocaInst *CreateEntryBlockAlloca(driver &drv, Function *TheFunction, StringRef VarName, Type *Ty,
+                                          Value *arraySize = nullptr) {
   IRBuilder<> TmpBuilder(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin()); // Genero un builder temporaneo
-  return TmpBuilder.CreateAlloca(Type::getDoubleTy(*drv.context), arraySize, VarName); // Creo l'istruzione alloca
+  return TmpBuilder.CreateAlloca(Ty, arraySize, VarName); // Creo l'istruzione alloca
+}
+
+/***************************** Tipi *******************************/
+// Tipo LLVM di un tipo del linguaggio
+static Type *llvmType(driver &drv, VarType T) {
+  return T == VarType::Int ? Type::getInt64Ty(*drv.context) : Type::getDoubleTy(*drv.context);
+}
+
+// Tipo di un parametro o di una variabile: scalare, puntatore o array
+static Type *llvmType(driver &drv, const TypedName &N) {
+  Type *T = llvmType(drv, N.type);
+  if (N.pointer)
+    return PointerType::getUnqual(T);
+  if (N.size)
+    return ArrayType::get(T, N.size);
+  return T;
+}
+
+// Nome con l'eventuale annotazione di tipo (visita dell'AST)
+static std::string typedName(const TypedName &N) {
+  std::string S = N.name->name.str();
+  if (N.size)
+    S += "[" + std::to_string(N.size) + "]";
+  if (N.type == VarType::Int || N.pointer)
+    S += N.type == VarType::Int ? ":int" : ":double";
+  return N.pointer ? S + "*" : S;
+}
+
+// Conversioni implicite, come in C: tra intero e double (troncando verso
+// zero), e il risultato di un confronto vale 0 o 1. Puntatori e array non
+// si convertono: restituisce nullptr (segnalando l'errore) se i tipi sono
+// incompatibili
+static Value *convert(driver &drv, Value *V, Type *To) {
+  Type *From = V->getType();
+  if (From == To)
+    return V;
+  if (!(From->isIntegerTy() || From->isFloatingPointTy()) ||
+      !(To->isIntegerTy() || To->isFloatingPointTy()))
+    return LogErrorV("Tipi incompatibili: gli array possono essere solo indicizzati o passati a una funzione");
+  if (From->isIntegerTy(1))
+    return To->isIntegerTy() ? drv.builder->CreateZExt(V, To, "booltoint")
+                             : drv.builder->CreateUIToFP(V, To, "booltofp");
+  if (From->isIntegerTy())
+    return To->isIntegerTy() ? drv.builder->CreateSExtOrTrunc(V, To, "intcast")
+                             : drv.builder->CreateSIToFP(V, To, "inttofp");
+  return drv.builder->CreateFPToSI(V, To, "fptoint");
+}
+
+// Costante double con un valore intero rappresentabile esattamente in un i64
+static Constant *asIntConstant(Value *V) {
+  auto *C = dyn_cast<ConstantFP>(V);
+  if (!C)
+    return nullptr;
+  APSInt I(64, false);
+  bool Exact;
+  if (C->getValueAPF().convertToInteger(I, APFloat::rmTowardZero, &Exact) != APFloat::opOK)
+    return nullptr;
+  return ConstantInt::get(C->getContext(), I);
+}
+
+// Tipo comune di due operandi: intero solo se lo sono entrambi, altrimenti
+// double. Una costante con valore intero si adatta all'altro operando, così
+// "i + 1" con i intero resta un'operazione intera
+static Type *commonType(driver &drv, Value *&L, Value *&R) {
+  auto isInt = [](Value *V) { return V->getType()->isIntegerTy(); };
+  if (isInt(L) && !isInt(R))
+    if (Constant *C = asIntConstant(R))
+      R = C;
+  if (isInt(R) && !isInt(L))
+    if (Constant *C = asIntConstant(L))
+      L = C;
+  return isInt(L) && isInt(R) ? Type::getInt64Ty(*drv.context) : Type::getDoubleTy(*drv.context);
+}
+
+// Condizione di if, for e while: vera se il valore è diverso da zero
+static Value *toCondition(driver &drv, Value *V, const Twine &Name) {
+  Type *T = V->getType();
+  if (T->isIntegerTy(1))
+    return V;
+  if (T->isIntegerTy())
+    return drv.builder->CreateICmpNE(V, ConstantInt::get(T, 0), Name);
+  if (!T->isFloatingPointTy())
+    return LogErrorV("Un array non può essere usato come condizione");
+  return drv.builder->CreateFCmpONE(V, ConstantFP::get(T, 0.0), Name);
+}
+
+/*********************** Hash per la cache ************************/
+static void hashInt(MD5 &H, uint64_t V) {
+  H.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(&V), sizeof(V)));
+}
+
+// Il terminatore separa i nomi adiacenti ("ab","c" da "a","bc")
+static void hashName(MD5 &H, Symbol *S) {
+  H.update(S->name);
+  H.update(ArrayRef<uint8_t>{0});
+}
+
+static void hashTyped(MD5 &H, const TypedName &N) {
+  hashName(H, N.name);
+  hashInt(H, (uint64_t)N.type | (uint64_t)N.pointer << 8 | (uint64_t)N.size << 16);
+}
+
+static void hashHints(MD5 &H, const LoopHints &L) {
+  hashInt(H, L.unroll | (uint64_t)L.vectorize << 16 | (uint64_t)L.interleave << 32 |
+             (uint64_t)L.independent << 48);
+}
+
+// Sottoespressione facoltativa (nullptr ha un proprio marcatore)
+static void hashOpt(MD5 &H, ExprAST *E) {
+  if (E)
+    E->hash(H);
+  else
+    H.update("0");
+}
+
+/*************************** AST arena ****************************/
+void ASTArena::reset() {
+  Peak = peak();
+  Total += Nodes.size();
+  for (RootAST *N : Nodes)
+    N->~RootAST();
+  Nodes.clear();
+  Alloc.Reset();
+}
+
+/**************************** Interner *****************************/
+// Restituisce il simbolo associato a Name, creandolo al primo incontro
+Symbol *Interner::intern(StringRef Name) {
+  auto I = Map.try_emplace(Name, nullptr);
+  if (I.second) {
+    Symbols.emplace_back();
+    Symbol *S = &Symbols.back();
+    S->name = I.first->getKey(); // La chiave è memorizzata dalla StringMap
+    S->id = Symbols.size() - 1;
+    I.first->second = S;
+  }
+  return I.first->second;
+}
+
+/********************** Scoped symbol table ***********************/
+void ScopedSymbolTable::bind(Symbol *S, AllocaInst *A) {
+  if (S->id >= Bindings.size())
+    Bindings.resize(S->id + 1, nullptr);
+  Undo.emplace_back(S->id, Bindings[S->id]);
+  Bindings[S->id] = A;
+  Version++;
+}
+
+// Ripristina i binding salvati nell'undo log a partire dalla posizione To
+void ScopedSymbolTable::rewind(size_t To) {
+  Version++;
+  while (Undo.size() > To) {
+    Bindings[Undo.back().first] = Undo.back().second;
+    Undo.pop_back();
+  }
+}
+
+void ScopedSymbolTable::pop() {
+  rewind(Scopes.back());
+  Scopes.pop_back();
+}
+
+// Svuota la tabella (inizio di una nuova funzione), anche se una codegen
+// fallita ha lasciato degli scope aperti
+void ScopedSymbolTable::clear() {
+  rewind(0);
+  Scopes.clear();
+}
+
+/********************* Semplificazione dell'AST *******************/
+void Simplifier::reset() {
+  Nodes.clear();
+  Bound.clear();
+}
+
+void Simplifier::bind(Symbol *S) {
+  if (S->id >= Bound.size())
+    Bound.resize(S->id + 1, 0);
+  Bound[S->id]++;
+}
+
+ExprAST *Simplifier::intern(ExprAST *E, char Kind, char Op, const void *A, const void *B,
+                            uint64_t Bits) {
+  auto I = Nodes.emplace(std::make_tuple(Kind, Op, A, B, Bits), E);
+  if (!I.second)
+    I.first->second->share();
+  return I.first->second;
+}
+
+// Nodo costante (anch'esso condiviso). La chiave è la rappresentazione in
+// bit del valore, così 0.0 e -0.0 (o NaN diversi) restano distinti
+ExprAST *Simplifier::number(double Val) {
+  uint64_t Bits;
+  memcpy(&Bits, &Val, sizeof(Bits));
+  auto I = Nodes.find(std::make_tuple('n', 0, nullptr, nullptr, Bits));
+  if (I != Nodes.end()) {
+    I->second->share();
+    return I->second;
+  }
+  return intern(Arena.make<NumberExprAST>(Val), 'n', 0, nullptr, nullptr, Bits);
+}
+
+// Come nel codegen, dove IRBuilder riduce il confronto tra costanti a un i1
+ExprAST *Simplifier::boolean(bool Val) {
+  auto I = Nodes.find(std::make_tuple('n', 1, nullptr, nullptr, (uint64_t)Val));
+  if (I != Nodes.end()) {
+    I->second->share();
+    return I->second;
+  }
+  return intern(Arena.make<NumberExprAST>(Val, true), 'n', 1, nullptr, nullptr, Val);
+}
+
+EffectScan::EffectScan(Symbol *Self, const std::vector<TypedName> &Args): Self(Self) {
+  for (const TypedName &Arg : Args) {
+    if (Arg.name->id >= Pointer.size())
+      Pointer.resize(Arg.name->id + 1, false);
+    Pointer[Arg.name->id] = Arg.pointer;
+  }
+  Bound.resize(Pointer.size(), 0);
+}
+
+void EffectScan::bind(Symbol *S) {
+  if (S->id >= Bound.size())
+    Bound.resize(S->id + 1, 0);
+  Bound[S->id]++;
+}
+
+// Gli effetti di una funzione chiamata si sommano a quelli del chiamante;
+// una funzione non analizzata (extern o non definita) può fare qualsiasi cosa
+void EffectScan::call(Symbol *Callee) {
+  if (Callee == Self) {
+    fx.recursive = fx.diverges = true;
+    return;
+  }
+  if (!Callee->proto || !Callee->proto->effects().known) {
+    fx.unknown = true;
+    return;
+  }
+  const Effects &C = Callee->proto->effects();
+  fx.reads |= C.reads;
+  fx.writes |= C.writes;
+  fx.unknown |= C.unknown;
+  fx.diverges |= C.diverges;
+}
+
+/*************************** Tempi delle fasi *********************/
+void PhaseTimer::charge() {
+  Clock::time_point Now = Clock::now();
+  Seconds[(int)Current] += std::chrono::duration<double>(Now - Since).count();
+  Since = Now;
+}
+
+Phase PhaseTimer::enter(Phase P) {
+  Phase Prev = Current;
+  if (enabled) {
+    charge();
+    Current = P;
+  }
+  return Prev;
+}
+
+void PhaseTimer::leave(Phase Prev) {
+  if (enabled) {
+    charge();
+    Current = Prev;
+  }
+}
+
+void PhaseTimer::report(raw_ostream &OS, StringRef Name) {
+  static const char *Names[] = { "altro", "scanner", "parser", "semplificazione",
+                                 "codegen", "verifica",
+                                 "ottimizzazione", "emissione", "JIT (con esecuzione)" };
+  charge();
+  double Total = 0;
+  for (double S : Seconds)
+    Total += S;
+  OS << "===== Tempi di compilazione: " << Name << " =====\n";
+  OS << "  " << left_justify("Fase", 22) << right_justify("Tempo (s)", 11)
+     << right_justify("%", 8) << "\n";
+  for (int P = 1; P <= (int)Phase::Count; ++P) {
+    int I = P % (int)Phase::Count; // "altro" in fondo
+    if (Seconds[I] == 0)
+      continue;
+    OS << "  " << left_justify(Names[I], 22) << format("%11.4f", Seconds[I])
+       << format("%7.1f%%", Total > 0 ? 100 * Seconds[I] / Total : 0.0) << "\n";
+  }
+  OS << "  " << left_justify("totale", 22) << format("%11.4f", Total) << "\n";
 }
 
 /*************************** Driver class *************************/
-driver::driver(): trace_parsing (false), trace_scanning (false), ast_print (false) {
+driver::driver(): Cnt (0), trace_parsing (false), scanner (nullptr), stdio_input (false),
+                  in_memory (false), mapped (nullptr), mapped_size (0), trace_scanning (false),
+                  ast_print (false), mem_stats (false), print_ir (false), simplify (true),
+                  fp_contract (FPContract::Off), instrumented (false), stores (0), moduleGen (0), lazy (false),
+                  streaming (false) {
   context = new LLVMContext;
   module = new Module("Kaleidoscope", *context);
   builder = new IRBuilder(*context);
 };
 
+driver::~driver() {
+  delete builder;
+  delete module;
+  // In modalità JIT il contesto è posseduto dal ThreadSafeContext
+  if (!jit)
+    delete context;
+};
+
 int driver::parse (const std::string &f) {
+  arena.reset();
+  arena.resetStats();
   file = f;
   location.initialize(&file);
-  scan_begin();
+  PhaseScope Scope(timer, Phase::Parse, "Parse", f);
+  if (scan_begin())
+    return 1;
   yy::parser parser(*this);
   parser.set_debug_level(trace_parsing);
   int res = parser.parse();
@@ -35,23 +344,231 @@ int driver::parse (const std::string &f) {
   return res;
 }
 
+// Analizza un sorgente già presente in memoria, senza accedere al filesystem;
+// name viene usato solo per le location dei messaggi di errore
+int driver::parse_string (const std::string &src, const std::string &name) {
+  buffer = src;
+  buffer.append(2, '\0'); // Flex richiede due caratteri nulli in fondo al buffer
+  in_memory = true;
+  int res = parse(name);
+  in_memory = false;
+  return res;
+}
+
 void driver::codegen() {
-  if (ast_print) root->visit();
-  std::cout << std::endl;
-  root->codegen(*this);
+  if (ast_print) {
+    root->visit();
+    std::cout << std::endl;
+  }
+  if (simplify) {
+    PhaseScope Scope(timer, Phase::Simplify, "Simplify");
+    Simplifier S(arena);
+    root = root->simplify(S);
+  }
+  {
+    PhaseScope Scope(timer, Phase::Codegen, "Codegen");
+    root->codegen(*this);
+  }
+  if (mem_stats)
+    std::cerr << "Arena AST: " << arena.total() << " nodi, "
+              << arena.peak() << " byte allocati (picco), "
+              << arena.reserved() << " byte riservati" << std::endl;
+  // L'AST non serve più: viene liberato in un colpo solo
+  arena.reset();
+  root = nullptr;
 };
 
+// Restituisce la funzione S nel modulo corrente; se è stata definita o
+// dichiarata in un modulo precedente (già passato al JIT) ne emette la
+// dichiarazione a partire dal prototipo registrato. Il risultato resta
+// memorizzato nel simbolo, così la ricerca per nome avviene una sola volta
+Function *driver::getFunction(Symbol *S) {
+  if (S->fn && S->fnGen == moduleGen)
+    return S->fn;
+  Function *F = module->getFunction(S->name);
+  if (!F && S->proto)
+    F = S->proto->declare(*this);
+  setFunction(S, F);
+  return F;
+}
+
+void driver::setFunction(Symbol *S, Function *F) {
+  S->fn = F;
+  S->fnGen = moduleGen;
+}
+
+// Valore già generato per la sottoespressione condivisa E, se ancora valido
+Value *driver::cseLookup(ExprAST *E) {
+  auto I = cse.find(E);
+  if (I == cse.end())
+    return nullptr;
+  const CSEEntry &C = I->second;
+  if (C.BB != builder->GetInsertBlock() || C.Scope != NamedValues.version() ||
+      C.Stores != stores)
+    return nullptr;
+  return C.V;
+}
+
+void driver::cseRecord(ExprAST *E, Value *V) {
+  cse[E] = CSEEntry{V, builder->GetInsertBlock(), NamedValues.version(), stores};
+}
+
+// I corpi dei parfor sono riferiti solo dalla funzione che li contiene (o,
+// se annidati, dal corpo che li contiene, estratto dopo di loro)
+void driver::eraseFunction(Function *F) {
+  F->eraseFromParent();
+  while (!outlined.empty()) {
+    outlined.back()->eraseFromParent();
+    outlined.pop_back();
+  }
+}
+
+/************************* JIT (--run) *************************/
+int driver::initJIT() {
+  auto J = orc::LLLazyJITBuilder().create();
+  if (!J) {
+    logAllUnhandledErrors(J.takeError(), errs(), "Impossibile creare il JIT: ");
+    return 1;
+  }
+  jit = std::move(*J);
+  // Le funzioni extern (es. quelle della libc) vengono risolte nel processo
+  auto Gen = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      jit->getDataLayout().getGlobalPrefix());
+  if (!Gen) {
+    logAllUnhandledErrors(Gen.takeError(), errs(), "Errore JIT: ");
+    return 1;
+  }
+  jit->getMainJITDylib().addGenerator(std::move(*Gen));
+  // Il runtime dei parfor è collegato a kfe ma non esportato dall'eseguibile
+  if (auto Err = jit->getMainJITDylib().define(orc::absoluteSymbols(
+          {{jit->mangleAndIntern("kfe_parfor"),
+            JITEvaluatedSymbol(pointerToJITTargetAddress(&kfe_parfor), JITSymbolFlags::Exported)}}))) {
+    logAllUnhandledErrors(std::move(Err), errs(), "Errore JIT: ");
+    return 1;
+  }
+  // Il contesto passa al JIT, che lo condivide con tutti i moduli
+  TSCtx = orc::ThreadSafeContext(std::unique_ptr<LLVMContext>(context));
+  module->setDataLayout(jit->getDataLayout());
+  module->setTargetTriple(jit->getTargetTriple().str());
+  return 0;
+}
+
+// Sostituisce il modulo corrente con uno nuovo, con lo stesso target.
+// Il modulo precedente deve essere già stato ceduto (JIT o moduleSink)
+void driver::newModule() {
+  Module *Old = module;
+  module = new Module("Kaleidoscope", *context);
+  module->setDataLayout(Old->getDataLayout());
+  module->setTargetTriple(Old->getTargetTriple());
+  moduleGen++; // Le funzioni memorizzate nei simboli non sono più valide
+}
+
+// Passa al JIT (o a moduleSink) le definizioni prodotte fino a questo momento
+void driver::flushModule() {
+  if (!jit && !moduleSink)
+    return;
+  bool hasBody = false;
+  for (auto &F : *module)
+    hasBody |= !F.isDeclaration();
+  if (!hasBody)
+    return;
+  std::unique_ptr<Module> M(module);
+  newModule();
+  if (!jit) {
+    moduleSink(std::move(M));
+    return;
+  }
+  if (jitOptimize) {
+    PhaseScope Scope(timer, Phase::Optimize, "Optimize");
+    jitOptimize(*M);
+  }
+  orc::ThreadSafeModule TSM(std::move(M), TSCtx);
+  Error Err = lazy ? jit->addLazyIRModule(std::move(TSM))
+                   : jit->addIRModule(std::move(TSM));
+  if (Err)
+    logAllUnhandledErrors(std::move(Err), errs(), "Errore JIT: ");
+}
+
+// Genera un elemento top-level appena ridotto dal parser (--stream) e ne
+// libera subito l'AST: l'occupazione di memoria dipende dall'elemento più
+// grande e non dalla dimensione del file
+void driver::stream(RootAST *item) {
+  if (ast_print) {
+    item->visit();
+    std::cout << ";" << "\n\n";
+  }
+  if (simplify) {
+    PhaseScope Scope(timer, Phase::Simplify, "Simplify");
+    Simplifier S(arena);
+    item = item->simplify(S);
+  }
+  // Una definizione già in cache non viene generata: basta registrarne il
+  // prototipo (con gli effetti) per le chiamate delle definizioni successive.
+  // L'hash è quello dell'AST semplificato, su cui si calcolano gli effetti
+  if (cacheLookup) {
+    MD5 H;
+    if (PrototypeAST *P = item->digest(H)) {
+      MD5::MD5Result R;
+      H.final(R);
+      if (cacheLookup(R.digest())) {
+        P->remember();
+        arena.reset();
+        return;
+      }
+    }
+  }
+  {
+    PhaseScope Scope(timer, Phase::Codegen, "Codegen");
+    item->codegen(*this);
+  }
+  flushModule();
+  arena.reset();
+}
+
+// Compila ed esegue la funzione anonima Name (espressione top-level),
+// stampando il valore calcolato. Il codice viene poi rimosso dal JIT
+void driver::jitEval(const std::string &Name) {
+  PhaseScope Scope(timer, Phase::Jit, "JITEval", Name);
+  auto RT = jit->getMainJITDylib().createResourceTracker();
+  std::unique_ptr<Module> M(module);
+  newModule();
+  if (jitOptimize) {
+    PhaseScope Scope(timer, Phase::Optimize, "Optimize");
+    jitOptimize(*M);
+  }
+  orc::ThreadSafeModule TSM(std::move(M), TSCtx);
+  if (Error Err = jit->addIRModule(RT, std::move(TSM))) {
+    logAllUnhandledErrors(std::move(Err), errs(), "Errore JIT: ");
+    return;
+  }
+  auto Sym = jit->lookup(Name);
+  if (!Sym) {
+    logAllUnhandledErrors(Sym.takeError(), errs(), "Errore JIT: ");
+    return;
+  }
+  double (*FP)() = (double (*)())(intptr_t)Sym->getAddress();
+  std::cout << FP() << std::endl;
+  if (Error Err = RT->remove())
+    logAllUnhandledErrors(std::move(Err), errs(), "Errore JIT: ");
+}
+
 /********************** Handle Top Expressions ********************/
 Value* TopExpression(ExprAST* E, driver& drv) {
   // Crea una funzione anonima anonima il cui body è un'espressione top-level
   // viene "racchiusa" un'espressione top-level
   E->toggle(); // Evita la doppia emissione del prototipo
-  PrototypeAST *Proto = new PrototypeAST("__espr_anonima"+std::to_string(++drv.Cnt),
-		  std::vector<std::string>());
+  PrototypeAST *Proto = drv.arena.make<PrototypeAST>(
+      drv.symbols.intern("__espr_anonima"+std::to_string(++drv.Cnt)), std::vector<TypedName>());
   Proto->noemit();
-  FunctionAST *F = new FunctionAST(std::move(Proto),E);
+  FunctionAST *F = drv.arena.make<FunctionAST>(std::move(Proto),E);
   auto *FnIR = F->codegen(drv);
-  FnIR->eraseFromParent();
+  if (!FnIR)
+    return nullptr;
+  drv.setFunction(Proto->getName(), nullptr);
+  if (drv.jit)
+    drv.jitEval(std::string(FnIR->getName())); // In modalità --run viene eseguita
+  else
+    drv.eraseFunction(FnIR);
   return nullptr;
 };
 
@@ -66,53 +583,93 @@ bool ExprAST::gettop() {
   return top;
 };
 
+// Un'espressione top-level sostituita da un altro nodo gli trasferisce il flag top
+RootAST *ExprAST::simplify(Simplifier &S) {
+  S.reset();
+  ExprAST *E = fold(S);
+  E->top = top;
+  return E;
+};
+
 /************************* Sequence tree **************************/
-SeqAST::SeqAST(RootAST* first, RootAST* continuation):
-  first(first), continuation(continuation) {};
+SeqAST::SeqAST(std::vector<RootAST*> stmts):
+  stmts(std::move(stmts)) {};
 
 void SeqAST:: visit() {
-  if (first != nullptr) {
-    first->visit();
-  } else {
-    if (continuation == nullptr) {
-      return;
-    };
-  };
-  std::cout << ";" << "\n\n";
-  continuation->visit();
+  for (RootAST *stmt : stmts) {
+    stmt->visit();
+    std::cout << ";" << "\n\n";
+  }
+};
+
+RootAST *SeqAST::simplify(Simplifier &S) {
+  for (RootAST *&stmt : stmts)
+    stmt = stmt->simplify(S);
+  return this;
 };
 
 Value *SeqAST::codegen(driver& drv) {
-  if (first != nullptr) {
-    Value *f = first->codegen(drv);
-  } else {
-    if (continuation == nullptr) return nullptr;
+  for (RootAST *stmt : stmts) {
+    stmt->codegen(drv);
+    drv.flushModule();
   }
-  Value *c = continuation->codegen(drv);
   return nullptr;
 };
 
 /********************* Number Expression Tree *********************/
-NumberExprAST::NumberExprAST(double Val): Val(Val) { top = false; };
+NumberExprAST::NumberExprAST(double Val, bool Bool): Val(Val), Bool(Bool) { top = false; };
 void NumberExprAST::visit() {
   std::cout << Val << " ";
 };
 
+void NumberExprAST::hash(MD5 &H) {
+  uint64_t Bits;
+  memcpy(&Bits, &Val, sizeof(Bits));
+  H.update(Bool ? "t" : "n");
+  hashInt(H, Bits);
+};
+
+void NumberExprAST::effects(EffectScan &S) {};
+
+ExprAST *NumberExprAST::fold(Simplifier &S) {
+  uint64_t Bits;
+  memcpy(&Bits, &Val, sizeof(Bits));
+  return S.intern(this, 'n', Bool, nullptr, nullptr, Bits);
+};
+
 Value *NumberExprAST::codegen(driver& drv) {  
   if (gettop()) return TopExpression(this, drv);
+  else if (Bool) return ConstantInt::getBool(*drv.context, Val != 0);
   else return ConstantFP::get(*drv.context, APFloat(Val));
 };
 
 /****************** Variable Expression TreeAST *******************/
-VariableExprAST::VariableExprAST(std::string &Name):
+VariableExprAST::VariableExprAST(Symbol *Name):
   Name(Name) { top = false; };
 
-const std::string& VariableExprAST::getName() const {
+Symbol *VariableExprAST::getName() const {
   return Name;
 };
 
 void VariableExprAST::visit() {
-  std::cout << getName() << " ";
+  std::cout << getName()->name.str() << " ";
+};
+
+void VariableExprAST::hash(MD5 &H) {
+  H.update("v");
+  hashName(H, Name);
+};
+
+void VariableExprAST::effects(EffectScan &S) {};
+
+ExprAST *VariableExprAST::fold(Simplifier &S) {
+  return S.intern(this, 'v', 0, Name, nullptr);
+};
+
+// Un riferimento a una variabile non legata non è puro: deve arrivare al
+// codegen, che ne segnala l'errore
+bool VariableExprAST::pure(Simplifier &S) {
+  return S.bound(Name);
 };
 
 Value *VariableExprAST::codegen(driver& drv) {
@@ -120,13 +677,17 @@ Value *VariableExprAST::codegen(driver& drv) {
     return TopExpression(this, drv);
 
   } else {
-    AllocaInst *A = drv.NamedValues[Name];
+    AllocaInst *A = drv.NamedValues.lookup(Name);
 
     if (!A)
       return LogErrorV("Unknown variable name");
 
+    // Il nome di un array denota il puntatore al suo primo elemento (come in C)
+    if (auto *AT = dyn_cast<ArrayType>(A->getAllocatedType()))
+      return drv.builder->CreateConstInBoundsGEP2_64(AT, A, 0, 0, Name->name);
+
     // "load" della variabile
-    return drv.builder->CreateLoad(A->getAllocatedType(), A, Name.c_str());
+    return drv.builder->CreateLoad(A->getAllocatedType(), A, Name->name);
   }
 };
 
@@ -144,6 +705,95 @@ void BinaryExprAST::visit() {
   std::cout << " )";
 };
 
+void BinaryExprAST::hash(MD5 &H) {
+  H.update(ArrayRef<uint8_t>{'b', (uint8_t)Op});
+  LHS->hash(H);
+  RHS->hash(H);
+};
+
+void BinaryExprAST::effects(EffectScan &S) {
+  LHS->effects(S);
+  RHS->effects(S);
+};
+
+ExprAST *BinaryExprAST::fold(Simplifier &S) {
+  // Il lato sinistro di '=' è la variabile assegnata: resta com'è
+  RHS = RHS->fold(S);
+  if (Op == '=')
+    return this;
+  LHS = LHS->fold(S);
+
+  // Il valore del lato sinistro di ':' viene scartato: se è puro non serve valutarlo
+  if (Op == ':')
+    return LHS->pure(S) ? RHS : this;
+
+  // Le operazioni tra costanti vengono calcolate, con la stessa semantica
+  // delle istruzioni generate (i confronti sono "ordered": falsi con NaN).
+  // Il risultato di un confronto è un i1, per cui l'aritmetica su di esso
+  // diventa intera (es. "(1 < 2) / 2" vale 0): la calcola il codegen
+  double L, R;
+  if (LHS->isConst(L) && RHS->isConst(R)) {
+    bool Ordered = !std::isnan(L) && !std::isnan(R);
+    bool Arith = !LHS->isBool() && !RHS->isBool();
+    switch (Op) {
+      case '+': if (Arith) return S.number(L + R); break;
+      case '-': if (Arith) return S.number(L - R); break;
+      case '*': if (Arith) return S.number(L * R); break;
+      case '/': if (Arith) return S.number(L / R); break;
+      case 'E': return S.boolean(L == R);
+      case 'N': return S.boolean(Ordered && L != R);
+      case '>': return S.boolean(L > R);
+      case '<': return S.boolean(L < R);
+      case 'g': return S.boolean(L >= R);
+      case 'l': return S.boolean(L <= R);
+    }
+  }
+  return S.intern(this, 'b', Op, LHS, RHS);
+};
+
+bool BinaryExprAST::pure(Simplifier &S) {
+  // Nelle sequenze annidate a sinistra l'eventuale assegnamento è più probabile a destra
+  return Op != '=' && RHS->pure(S) && LHS->pure(S);
+};
+
+// Il valore di una sequenza è quello del lato destro
+void BinaryExprAST::markTail() {
+  if (Op == ':')
+    RHS->markTail();
+};
+
+// -ffp-contract=on: un prodotto sommato (o sottratto) nella stessa
+// espressione diventa llvm.fmuladd, che il backend fonde in una FMA se il
+// target la supporta. Il prodotto, appena generato e non condiviso, viene
+// rimosso
+static Value *fuseMulAdd(driver &drv, char Op, Value *L, Value *R, ExprAST *LE, ExprAST *RE) {
+  auto product = [](Value *V, ExprAST *E) -> BinaryOperator* {
+    auto *M = dyn_cast<BinaryOperator>(V);
+    if (M && M->getOpcode() == Instruction::FMul && M->use_empty() && !E->isShared())
+      return M;
+    return nullptr;
+  };
+  BinaryOperator *M = product(R, RE);
+  Value *Addend = L;
+  if (!M) {
+    M = product(L, LE);
+    Addend = R;
+  }
+  if (!M)
+    return nullptr;
+  Value *A = M->getOperand(0), *B = M->getOperand(1);
+  if (Op == '-') {
+    if (M == R)
+      A = drv.builder->CreateFNeg(A); // L - a*b = (-a)*b + L
+    else
+      Addend = drv.builder->CreateFNeg(Addend);
+  }
+  Value *Res = drv.builder->CreateIntrinsic(Intrinsic::fmuladd, {A->getType()},
+                                            {A, B, Addend}, nullptr, "fmaregister");
+  M->eraseFromParent();
+  return Res;
+}
+
 Value *BinaryExprAST::codegen(driver& drv) {
   if (gettop()) {
     return TopExpression(this, drv);
@@ -163,73 +813,151 @@ Value *BinaryExprAST::codegen(driver& drv) {
         return nullptr;
 
       // Controlliamo l'esistenza nella tabella dei simboli
-      Value *Variable = drv.NamedValues[LHSE->getName()];
+      AllocaInst *Variable = drv.NamedValues.lookup(LHSE->getName());
       if (!Variable)
         return LogErrorV("Unknown variable name");
      
-      // Generiamo la "store"
+      // Generiamo la "store", convertendo il valore nel tipo della variabile
+      Val = convert(drv, Val, Variable->getAllocatedType());
+      if (!Val)
+        return nullptr;
       drv.builder->CreateStore(Val, Variable);
+      drv.stores++;
       return Val;
     }
 
+    // Sottoespressione condivisa già calcolata in questo punto
+    if (shared)
+      if (Value *V = drv.cseLookup(this))
+        return V;
+
     Value *L = LHS->codegen(drv);
     Value *R = RHS->codegen(drv);
 
     if (!L || !R)
       return nullptr;
 
-    switch (Op) {
-      case '+':
-        return drv.builder->CreateFAdd(L, R, "addregister");
-      case '-':
-        return drv.builder->CreateFSub(L, R, "subregister");
-      case '*':
-        return drv.builder->CreateFMul(L, R, "mulregister");
-      case '/':
-        return drv.builder->CreateFDiv(L, R, "addregister");
-      
-      /***** Estensione 1 *****/
-      case 'E':
-        return drv.builder->CreateFCmpOEQ(L, R, "eqregister");
-      case 'N': 
-        return drv.builder->CreateFCmpONE(L, R, "neregister");
-      case '>': 
-        return drv.builder->CreateFCmpOGT(L, R, "gtregister");
-      case '<': 
-        return drv.builder->CreateFCmpOLT(L, R, "ltregister");
-      case 'g': 
-        return drv.builder->CreateFCmpOGE(L, R, "geregister");
-      case 'l': 
-        return drv.builder->CreateFCmpOLE(L, R, "leregister");
-      
-      /***** Estensione 2 *****/
-      case ':':
-        return R;
+    /***** Estensione 2 *****/
+    if (Op == ':')
+      return R;
 
-      default:  
-        return LogErrorV("Operatore binario non supportato");
+    // Operazione intera se entrambi gli operandi sono interi, altrimenti in
+    // virgola mobile. Come in C l'overflow intero non è definito (nsw) e la
+    // divisione tra interi tronca verso zero
+    Type *T = commonType(drv, L, R);
+    L = convert(drv, L, T);
+    R = convert(drv, R, T);
+    if (!L || !R)
+      return nullptr;
+
+    Value *Res;
+    if (T->isIntegerTy()) {
+      switch (Op) {
+        case '+':
+          Res = drv.builder->CreateNSWAdd(L, R, "addregister"); break;
+        case '-':
+          Res = drv.builder->CreateNSWSub(L, R, "subregister"); break;
+        case '*':
+          Res = drv.builder->CreateNSWMul(L, R, "mulregister"); break;
+        case '/':
+          Res = drv.builder->CreateSDiv(L, R, "divregister"); break;
+        case 'E':
+          Res = drv.builder->CreateICmpEQ(L, R, "eqregister"); break;
+        case 'N':
+          Res = drv.builder->CreateICmpNE(L, R, "neregister"); break;
+        case '>':
+          Res = drv.builder->CreateICmpSGT(L, R, "gtregister"); break;
+        case '<':
+          Res = drv.builder->CreateICmpSLT(L, R, "ltregister"); break;
+        case 'g':
+          Res = drv.builder->CreateICmpSGE(L, R, "geregister"); break;
+        case 'l':
+          Res = drv.builder->CreateICmpSLE(L, R, "leregister"); break;
+        default:
+          return LogErrorV("Operatore binario non supportato");
+      }
+    } else if ((Op == '+' || Op == '-') && drv.fp_contract == FPContract::On &&
+               (Res = fuseMulAdd(drv, Op, L, R, LHS, RHS))) {
+      // Prodotto e somma fusi in llvm.fmuladd
+    } else {
+      switch (Op) {
+        case '+':
+          Res = drv.builder->CreateFAdd(L, R, "addregister"); break;
+        case '-':
+          Res = drv.builder->CreateFSub(L, R, "subregister"); break;
+        case '*':
+          Res = drv.builder->CreateFMul(L, R, "mulregister"); break;
+        case '/':
+          Res = drv.builder->CreateFDiv(L, R, "addregister"); break;
+        
+        /***** Estensione 1 *****/
+        case 'E':
+          Res = drv.builder->CreateFCmpOEQ(L, R, "eqregister"); break;
+        case 'N': 
+          Res = drv.builder->CreateFCmpONE(L, R, "neregister"); break;
+        case '>': 
+          Res = drv.builder->CreateFCmpOGT(L, R, "gtregister"); break;
+        case '<': 
+          Res = drv.builder->CreateFCmpOLT(L, R, "ltregister"); break;
+        case 'g': 
+          Res = drv.builder->CreateFCmpOGE(L, R, "geregister"); break;
+        case 'l': 
+          Res = drv.builder->CreateFCmpOLE(L, R, "leregister"); break;
+
+        default:  
+          return LogErrorV("Operatore binario non supportato");
+      }
     }
+    if (shared)
+      drv.cseRecord(this, Res);
+    return Res;
   }
 };
 
 /********************* Call Expression Tree ***********************/
-CallExprAST::CallExprAST(std::string Callee, std::vector<ExprAST*> Args): Callee(Callee),
+CallExprAST::CallExprAST(Symbol *Callee, std::vector<ExprAST*> Args): Callee(Callee),
 									  Args(std::move(Args)) { top = false; };
                     
 void CallExprAST::visit() {
-  std::cout << Callee << "( ";
+  std::cout << Callee->name.str() << "( ";
   for (ExprAST* arg : Args) {
     arg->visit();
   };
   std::cout << ')';
 };
 
+// Il codice della chiamata dipende anche dai tipi dei parametri della
+// funzione chiamata (conversioni degli argomenti)
+void CallExprAST::hash(MD5 &H) {
+  H.update("c");
+  hashName(H, Callee);
+  hashInt(H, Args.size());
+  for (ExprAST *Arg : Args)
+    Arg->hash(H);
+  if (Callee->proto)
+    Callee->proto->hash(H);
+  else
+    H.update("?");
+};
+
+void CallExprAST::effects(EffectScan &S) {
+  for (ExprAST *Arg : Args)
+    Arg->effects(S);
+  S.call(Callee);
+};
+
+ExprAST *CallExprAST::fold(Simplifier &S) {
+  for (ExprAST *&Arg : Args)
+    Arg = Arg->fold(S);
+  return this;
+};
+
 Value *CallExprAST::codegen(driver& drv) {
   if (gettop()) {
     return TopExpression(this, drv);
   } else {
     // Cerchiamo la funzione nell'ambiente globale
-    Function *CalleeF = drv.module->getFunction(Callee);
+    Function *CalleeF = drv.getFunction(Callee);
     if (!CalleeF)
       return LogErrorV("Funzione non definita");
     // Controlliamo che gli argomenti coincidano in numero coi parametri
@@ -237,54 +965,144 @@ Value *CallExprAST::codegen(driver& drv) {
       return LogErrorV("Numero di argomenti non corretto");
     std::vector<Value *> ArgsV;
     for (auto arg : Args) {
-      ArgsV.push_back(arg->codegen(drv));
-      if (!ArgsV.back())
+      Value *V = arg->codegen(drv);
+      if (!V)
 	return nullptr;
+      // Ogni argomento viene convertito nel tipo del parametro
+      V = convert(drv, V, CalleeF->getArg(ArgsV.size())->getType());
+      if (!V)
+        return nullptr;
+      ArgsV.push_back(V);
     }
-    return drv.builder->CreateCall(CalleeF, ArgsV, "calltmp");
+    CallInst *Call = drv.builder->CreateCall(CalleeF, ArgsV, "calltmp");
+    Call->setCallingConv(CalleeF->getCallingConv());
+    if (!tail)
+      return Call;
+
+    // In posizione di coda la chiamata è seguita direttamente dal ret. Se
+    // la funzione chiamata ha la stessa firma del chiamante è musttail (non
+    // fa crescere lo stack neanche senza ottimizzazioni), altrimenti tail.
+    // Un array locale passato come argomento vive nel frame del chiamante:
+    // la chiamata resta normale
+    Function *Caller = drv.builder->GetInsertBlock()->getParent();
+    bool Local = any_of(ArgsV, [](Value *V) {
+      return V->getType()->isPointerTy() && isa<AllocaInst>(getUnderlyingObject(V));
+    });
+    if (!Local)
+      Call->setTailCallKind(Caller->getFunctionType() == CalleeF->getFunctionType() &&
+                            Caller->getCallingConv() == CalleeF->getCallingConv()
+                            ? CallInst::TCK_MustTail : CallInst::TCK_Tail);
+    drv.builder->CreateRet(Call);
+    return Call;
   }
 }
 
 /************************* Prototype Tree *************************/
-PrototypeAST::PrototypeAST(std::string Name, std::vector<std::string> Args): Name(Name),
+PrototypeAST::PrototypeAST(Symbol *Name, std::vector<TypedName> Args): Name(Name),
 									     Args(std::move(Args)) { emit = true; };
-const std::string& PrototypeAST::getName() const { return Name; };
-const std::vector<std::string>& PrototypeAST::getArgs() const { return Args; };
+Symbol *PrototypeAST::getName() const { return Name; };
+const std::vector<TypedName>& PrototypeAST::getArgs() const { return Args; };
 void PrototypeAST::visit() {
-  std::cout << "EXTERN " << getName() << "( ";
+  std::cout << "EXTERN " << getName()->name.str() << "( ";
   for (auto it=getArgs().begin(); it!= getArgs().end(); ++it) {
-    std::cout << *it << ' ';
+    std::cout << typedName(*it) << ' ';
   };
   std::cout << ')';
 };
 
+// Gli effetti determinano gli attributi della funzione (e quindi il codice
+// dei chiamanti)
+void PrototypeAST::hash(MD5 &H) {
+  H.update("p");
+  hashName(H, Name);
+  hashInt(H, Args.size());
+  for (const TypedName &Arg : Args)
+    hashTyped(H, Arg);
+  H.update(ArrayRef<uint8_t>{fx.known, fx.reads, fx.writes, fx.unknown, fx.diverges,
+                             fx.recursive});
+};
+
+// Registra il prototipo nel simbolo, per le dichiarazioni nei moduli successivi
+void PrototypeAST::remember() {
+  Name->proto = std::make_unique<PrototypeAST>(*this);
+};
+
 void PrototypeAST::noemit() { emit = false; };
 
 bool PrototypeAST::emitp() { return emit; };
 
 Function *PrototypeAST::codegen(driver& drv) {
-  // Costruisce una struttura double(double,...,double) che descrive 
-  // tipo di ritorno e tipo dei parametri (in Kaleidoscope solo double)
-  std::vector<Type*> Doubles(Args.size(), Type::getDoubleTy(*drv.context));
+  Function *F = declare(drv);
+  remember();
+
+  // emitp() restituisce true se e solo se il prototipo è definito extern
+  if (drv.print_ir && emitp()) {
+    F->print(errs());
+    errs() << "\n";
+  };
+  
+  return F;
+}
+
+// Emette nel modulo corrente la dichiarazione della funzione
+Function *PrototypeAST::declare(driver& drv) {
+  // Costruisce una struttura double(T1,...,Tn) che descrive tipo di ritorno
+  // e tipo dei parametri (double, o i64 per i parametri interi)
+  std::vector<Type*> Params;
+  for (const TypedName &Arg : Args)
+    Params.push_back(llvmType(drv, Arg));
   FunctionType *FT =
-      FunctionType::get(Type::getDoubleTy(*drv.context), Doubles, false);
+      FunctionType::get(Type::getDoubleTy(*drv.context), Params, false);
   Function *F =
-      Function::Create(FT, Function::ExternalLinkage, Name, *drv.module);
+      Function::Create(FT, Function::ExternalLinkage, Name->name, *drv.module);
 
-  // Attribuiamo agli argomenti il nome dei parametri formali specificati dal programmatore
+  // Attribuiamo agli argomenti il nome dei parametri formali specificati dal programmatore.
+  // Come con restrict in C, i buffer passati a parametri diversi non si
+  // sovrappongono: i puntatori sono noalias
   unsigned Idx = 0;
-  for (auto &Arg : F->args())
-    Arg.setName(Args[Idx++]);
+  for (auto &Arg : F->args()) {
+    if (Args[Idx].pointer)
+      Arg.addAttr(Attribute::NoAlias);
+    Arg.setName(Args[Idx++].name->name);
+  }
 
-  if (emitp()) {  // emitp() restituisce true se e solo se il prototipo è definito extern
-    F->print(errs());
-    fprintf(stderr, "\n");
-  };
-  
+  // Attributi dimostrati dall'analisi degli effetti (solo per le funzioni
+  // definite: di un extern non si sa nulla). Senza extern tra le funzioni
+  // chiamate non ci sono eccezioni né altri accessi alla memoria, e la
+  // ricorsione può essere solo diretta. Il codice strumentato per PGO
+  // aggiorna i contatori in memoria: niente readnone e readonly
+  if (fx.known && !fx.unknown) {
+    F->addFnAttr(Attribute::NoUnwind);
+    if (!drv.instrumented && !fx.reads && !fx.writes)
+      F->addFnAttr(Attribute::ReadNone);
+    else if (!drv.instrumented && !fx.writes)
+      F->addFnAttr(Attribute::ReadOnly);
+    if (!fx.diverges)
+      F->addFnAttr(Attribute::WillReturn);
+    if (!fx.recursive)
+      F->addFnAttr(Attribute::NoRecurse);
+  }
+
+  drv.setFunction(Name, F);
   return F;
 }
 
 /************************* Function Tree **************************/
+// Attributi corrispondenti ai flag fast-math, usati dal backend (es. nella
+// selezione delle istruzioni) per le ottimizzazioni che non lavorano sull'IR
+static void fastMathAttributes(Function *F, FastMathFlags FMF) {
+  if (FMF.noNaNs())
+    F->addFnAttr("no-nans-fp-math", "true");
+  if (FMF.noInfs())
+    F->addFnAttr("no-infs-fp-math", "true");
+  if (FMF.noSignedZeros())
+    F->addFnAttr("no-signed-zeros-fp-math", "true");
+  if (FMF.approxFunc())
+    F->addFnAttr("approx-func-fp-math", "true");
+  if (FMF.allowReassoc() && FMF.allowReciprocal() && FMF.noSignedZeros() && FMF.approxFunc())
+    F->addFnAttr("unsafe-fp-math", "true");
+}
+
 FunctionAST::FunctionAST(PrototypeAST* Proto, ExprAST* Body):
   Proto(Proto), Body(Body) {
   if (Body == nullptr) external=true;
@@ -292,23 +1110,52 @@ FunctionAST::FunctionAST(PrototypeAST* Proto, ExprAST* Body):
 };
 
 void FunctionAST::visit() {
-  std::cout << Proto->getName() << "( ";
+  if (fastmath)
+    std::cout << "FASTMATH ";
+  std::cout << Proto->getName()->name.str() << "( ";
   for (auto it=Proto->getArgs().begin(); it!= Proto->getArgs().end(); ++it) {
-    std::cout << *it << ' ';
+    std::cout << typedName(*it) << ' ';
   };
   std::cout << ')';
   Body->visit();
 };
 
+// Calcola gli effetti della definizione e li registra nel prototipo
+void FunctionAST::analyze() {
+  EffectScan S(Proto->getName(), Proto->getArgs());
+  Body->effects(S);
+  S.fx.known = true;
+  Proto->setEffects(S.fx);
+};
+
+PrototypeAST *FunctionAST::digest(MD5 &H) {
+  analyze();
+  H.update(ArrayRef<uint8_t>{fastmath});
+  Proto->hash(H);
+  Body->hash(H);
+  return Proto;
+};
+
+RootAST *FunctionAST::simplify(Simplifier &S) {
+  S.reset();
+  for (const TypedName &Arg : Proto->getArgs())
+    S.bind(Arg.name);
+  Body = Body->fold(S);
+  return this;
+};
+
 Function *FunctionAST::codegen(driver& drv) {
   // Verifica che non esiste già, nel contesto, una funzione con lo stesso nome
-  std::string name = Proto->getName();
-  Function *TheFunction = drv.module->getFunction(name);
+  Symbol *name = Proto->getName();
+  PhaseScope Scope(drv.timer, Phase::Codegen, "CodegenFunction", name->name);
+  Function *TheFunction = drv.getFunction(name);
   // E se non esiste prova a definirla
   if (TheFunction) {
-    LogErrorV("Funzione "+name+" già definita");
+    LogErrorV("Funzione "+name->name.str()+" già definita");
     return nullptr;
   }
+  analyze();
+  drv.outlined.clear();
   if (!TheFunction)
     TheFunction = Proto->codegen(drv);
   if (!TheFunction)
@@ -318,44 +1165,68 @@ Function *FunctionAST::codegen(driver& drv) {
   BasicBlock *BB = BasicBlock::Create(*drv.context, "entry", TheFunction);
   drv.builder->SetInsertPoint(BB);
 
+  // Flag fast-math delle operazioni in virgola mobile della funzione
+  FastMathFlags FMF = fastmath ? FastMathFlags::getFast() : drv.fmf;
+  drv.builder->setFastMathFlags(FMF);
+  fastMathAttributes(TheFunction, FMF);
+
   // Registra gli argomenti nella symbol table
   drv.NamedValues.clear();
+  drv.cse.clear();
 
   // Modifico questo codegen perchè per ogni argomento, creiamo un'alloca, memorizziamo il
   // valore di input della funzione nell'alloca e registriamo l'alloca come posizione di memoria per l'argomento.
+  unsigned Idx = 0;
   for (auto &Arg : TheFunction->args()) {
-    // Creo un alloca per quella variabile
-    AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, std::string(Arg.getName()));
+    Symbol *ArgName = Proto->getArgs()[Idx++].name;
+    // Creo un alloca per quella variabile, dello stesso tipo del parametro
+    AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, ArgName->name, Arg.getType());
 
     // Creo una store per salvare il valore iniziale
     drv.builder->CreateStore(&Arg, Alloca);
 
     // Aggiungo argomento alla tabella dei simboli
-    drv.NamedValues[std::string(Arg.getName())] = Alloca;
+    drv.NamedValues.bind(ArgName, Alloca);
   }
 
-  if (Value *RetVal = Body->codegen(drv)) {
+  // Le chiamate in posizione di coda emettono da sé il ret
+  Body->markTail();
+  Value *RetVal = Body->codegen(drv);
+  if (RetVal && !drv.builder->GetInsertBlock()->getTerminator()) {
+    RetVal = convert(drv, RetVal, TheFunction->getReturnType());
     // Termina la creazione del codice corrispondente alla funzione
-    drv.builder->CreateRet(RetVal);
+    if (RetVal)
+      drv.builder->CreateRet(RetVal);
+  }
+  if (RetVal) {
 
     // Effettua la validazione del codice e un controllo di consistenza
-    raw_os_ostream ostream(std::cout);
-    std::cerr<<"\n";
-    if(verifyFunction(*TheFunction, &ostream))
+    bool Broken;
     {
-      std::cerr<<"\nErrore: Funzione malformata\n";
+      PhaseScope Verify(drv.timer, Phase::Verify, "VerifyFunction", name->name);
+      Broken = verifyFunction(*TheFunction, &errs());
+    }
+    if(Broken)
+    {
+      errs() << "\nErrore: Funzione malformata\n";
 
-      TheFunction->eraseFromParent();
+      drv.eraseFunction(TheFunction);
+      drv.setFunction(name, nullptr);
+      name->proto.reset();
       return nullptr;
     }
 
-    TheFunction->print(errs());
-    fprintf(stderr, "\n");
+    if (drv.print_ir) {
+      TheFunction->print(errs());
+      errs() << "\n";
+    }
     return TheFunction;
   }
 
   // Errore nella definizione. La funzione viene rimossa
-  TheFunction->eraseFromParent();
+  drv.eraseFunction(TheFunction);
+  drv.setFunction(name, nullptr);
+  name->proto.reset();
   return nullptr;
 };
 
@@ -377,6 +1248,51 @@ void IfExprAST::visit() {
   std::cout<<" ) ) ";
 };
 
+void IfExprAST::hash(MD5 &H) {
+  H.update("i");
+  condizione->hash(H);
+  branchTrue->hash(H);
+  branchFalse->hash(H);
+};
+
+void IfExprAST::effects(EffectScan &S) {
+  condizione->effects(S);
+  branchTrue->effects(S);
+  branchFalse->effects(S);
+};
+
+// Con una condizione costante resta solo il ramo scelto
+ExprAST *IfExprAST::fold(Simplifier &S) {
+  condizione = condizione->fold(S);
+  branchTrue = branchTrue->fold(S);
+  branchFalse = branchFalse->fold(S);
+  double C;
+  if (condizione->isConst(C))
+    return (!std::isnan(C) && C != 0) ? branchTrue : branchFalse; // Come fcmp one
+  return this;
+};
+
+bool IfExprAST::pure(Simplifier &S) {
+  return condizione->pure(S) && branchTrue->pure(S) && branchFalse->pure(S);
+};
+
+void IfExprAST::markTail() {
+  tail = true;
+  branchTrue->markTail();
+  branchFalse->markTail();
+};
+
+// Chiude un ramo di un if in posizione di coda restituendone il valore
+static bool returnFromBranch(driver &drv, Value *V) {
+  if (drv.builder->GetInsertBlock()->getTerminator())
+    return true;
+  V = convert(drv, V, Type::getDoubleTy(*drv.context));
+  if (!V)
+    return false;
+  drv.builder->CreateRet(V);
+  return true;
+}
+
 Value *IfExprAST::codegen(driver &drv) {
   // verifico che non sia un istruzione di tipo top
   if(gettop()) {
@@ -388,8 +1304,10 @@ Value *IfExprAST::codegen(driver &drv) {
     if(!checkCond)
       return nullptr;
     
-    if(checkCond->getType()->isDoubleTy()) //controllo se la costante dell'espressione è un double
-      checkCond = drv.builder->CreateFCmpONE(checkCond, ConstantFP::get(*drv.context, APFloat(0.0)), " IF COND DOUBLE ");
+    // Se la condizione non è già un booleano la confronto con zero
+    checkCond = toCondition(drv, checkCond, " IF COND ");
+    if (!checkCond)
+      return nullptr;
     
     Function *func = drv.builder->GetInsertBlock()->getParent();  // dove devo scrivere, prendo il blocco della funzione blocco entry
 
@@ -405,6 +1323,20 @@ Value *IfExprAST::codegen(driver &drv) {
     if(!thenCode)
       return nullptr;
 
+    // In posizione di coda ogni ramo termina con il proprio ret (emesso
+    // dalla chiamata in coda, se c'è): non servono MERGE e PHI
+    if (tail) {
+      delete MergeBB;
+      if (!returnFromBranch(drv, thenCode))
+        return nullptr;
+      func->getBasicBlockList().push_back(ElseBB);
+      drv.builder->SetInsertPoint(ElseBB);
+      Value *elseCode = branchFalse->codegen(drv);
+      if (!elseCode || !returnFromBranch(drv, elseCode))
+        return nullptr;
+      return elseCode;
+    }
+
     drv.builder->CreateBr(MergeBB);
 
     // Mantengo un puntatore all'inizio del BasicBlock, utile per il PHI
@@ -429,7 +1361,19 @@ Value *IfExprAST::codegen(driver &drv) {
 
     drv.builder->SetInsertPoint(MergeBB);
 
-    PHINode *phiInstr = drv.builder->CreatePHI(Type::getDoubleTy(*drv.context), 2, "phi");
+    // I due rami vengono portati al tipo comune, con le conversioni in fondo a ciascun ramo
+    Type *T = commonType(drv, thenCode, elseCode);
+    {
+      IRBuilderBase::InsertPointGuard Guard(*drv.builder);
+      drv.builder->SetInsertPoint(ThenBB->getTerminator());
+      thenCode = convert(drv, thenCode, T);
+      drv.builder->SetInsertPoint(ElseBB->getTerminator());
+      elseCode = convert(drv, elseCode, T);
+    }
+    if (!thenCode || !elseCode)
+      return nullptr;
+
+    PHINode *phiInstr = drv.builder->CreatePHI(T, 2, "phi");
 
     phiInstr->addIncoming(thenCode, ThenBB);
     phiInstr->addIncoming(elseCode, ElseBB);
@@ -452,12 +1396,40 @@ void UnaryExprAST::visit() {
 };
 
 
+void UnaryExprAST::hash(MD5 &H) {
+  H.update(ArrayRef<uint8_t>{'u', (uint8_t)operand});
+  espressione->hash(H);
+};
+
+void UnaryExprAST::effects(EffectScan &S) {
+  espressione->effects(S);
+};
+
+ExprAST *UnaryExprAST::fold(Simplifier &S) {
+  espressione = espressione->fold(S);
+  if (operand == '+')
+    return espressione;
+  double V;
+  if (operand == '-' && espressione->isConst(V) && !espressione->isBool())
+    return S.number(0.0 - V); // Come la fsub generata (0 - 0 è +0)
+  return S.intern(this, 'u', operand, espressione, nullptr);
+};
+
+bool UnaryExprAST::pure(Simplifier &S) {
+  return espressione->pure(S);
+};
+
 Value *UnaryExprAST::codegen(driver &drv) {
   // Verifico che non sia un istruzione di tipo top
   if(gettop()) {
     return TopExpression(this, drv);
 
   } else {
+    // Sottoespressione condivisa già calcolata in questo punto
+    if (shared)
+      if (Value *V = drv.cseLookup(this))
+        return V;
+
     Value *checkCond = espressione->codegen(drv);
 
     if(!checkCond)
@@ -468,9 +1440,21 @@ Value *UnaryExprAST::codegen(driver &drv) {
         return checkCond;
         break;
       
-      case '-' :
-        return drv.builder->CreateFSub(ConstantFP::get(Type::getDoubleTy(*drv.context), 0), checkCond, "negativeRegister");
-        break;
+      case '-' : {
+        Value *Res;
+        if (checkCond->getType()->isIntegerTy()) {
+          checkCond = convert(drv, checkCond, Type::getInt64Ty(*drv.context));
+          Res = drv.builder->CreateNSWNeg(checkCond, "negativeRegister");
+        } else {
+          checkCond = convert(drv, checkCond, Type::getDoubleTy(*drv.context));
+          if (!checkCond)
+            return nullptr;
+          Res = drv.builder->CreateFSub(ConstantFP::get(Type::getDoubleTy(*drv.context), 0), checkCond, "negativeRegister");
+        }
+        if (shared)
+          drv.cseRecord(this, Res);
+        return Res;
+      }
 
       default:
         return LogErrorV("Operatore binario non supportato");
@@ -478,17 +1462,71 @@ Value *UnaryExprAST::codegen(driver &drv) {
   }
 }
 
+/********************** Annotazioni dei loop **********************/
+// Stampa le annotazioni (visita dell'AST)
+static void visitHints(const LoopHints &H) {
+  if (H.unroll) std::cout << " UNROLL(" << H.unroll << ")";
+  if (H.vectorize) std::cout << " VECTORIZE(" << H.vectorize << ")";
+  if (H.interleave) std::cout << " INTERLEAVE(" << H.interleave << ")";
+  if (H.independent) std::cout << " INDEPENDENT";
+}
+
+static Metadata *loopProperty(LLVMContext &C, StringRef Name, unsigned Val) {
+  return MDNode::get(C, {MDString::get(C, Name),
+                         ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(C), Val))});
+}
+
+// Traduce le annotazioni in metadati llvm.loop sul branch del back-edge.
+// Con "independent" tutti gli accessi a memoria del loop (i blocchi creati
+// dopo Last) entrano in un access group dichiarato parallelo
+static void addLoopMetadata(driver &drv, BranchInst *BackEdge, const LoopHints &H,
+                            BasicBlock *Last) {
+  if (!H.unroll && !H.vectorize && !H.interleave && !H.independent)
+    return;
+  LLVMContext &C = *drv.context;
+  SmallVector<Metadata*, 6> MDs;
+  MDs.push_back(nullptr); // Riferimento a sé stesso, come richiesto per i loop ID
+  if (H.unroll == 1)
+    MDs.push_back(MDNode::get(C, MDString::get(C, "llvm.loop.unroll.disable")));
+  else if (H.unroll)
+    MDs.push_back(loopProperty(C, "llvm.loop.unroll.count", H.unroll));
+  if (H.vectorize) {
+    MDs.push_back(MDNode::get(C, {MDString::get(C, "llvm.loop.vectorize.enable"),
+                                  ConstantAsMetadata::get(ConstantInt::get(Type::getInt1Ty(C),
+                                                                           H.vectorize > 1))}));
+    MDs.push_back(loopProperty(C, "llvm.loop.vectorize.width", H.vectorize));
+  }
+  if (H.interleave)
+    MDs.push_back(loopProperty(C, "llvm.loop.interleave.count", H.interleave));
+  if (H.independent) {
+    MDNode *Group = MDNode::getDistinct(C, {});
+    MDs.push_back(MDNode::get(C, {MDString::get(C, "llvm.loop.parallel_accesses"), Group}));
+    Function *F = BackEdge->getFunction();
+    for (auto BB = std::next(Last->getIterator()); BB != F->end(); ++BB)
+      for (Instruction &I : *BB)
+        if (I.mayReadOrWriteMemory())
+          I.setMetadata(LLVMContext::MD_access_group,
+                        uniteAccessGroups(I.getMetadata(LLVMContext::MD_access_group), Group));
+  }
+  MDNode *LoopID = MDNode::getDistinct(C, MDs);
+  LoopID->replaceOperandWith(0, LoopID);
+  BackEdge->setMetadata(LLVMContext::MD_loop, LoopID);
+}
+
 /************************* Estensione 3,(adattamento per estensione 4) **************************/
-ForExprAST::ForExprAST(std::string id, ExprAST* init, ExprAST* exp, ExprAST* step, ExprAST* stmt) :
-  id(std::move(id)),
+ForExprAST::ForExprAST(TypedName id, ExprAST* init, ExprAST* exp, ExprAST* step, ExprAST* stmt,
+                       LoopHints hints) :
+  id(id.name),
+  type(id.type),
   init(std::move(init)),
   exp(std::move(exp)),
   step(std::move(step)),
-  stmt(std::move(stmt))
+  stmt(std::move(stmt)),
+  hints(hints)
   {top = false;}
 
 void ForExprAST::visit() {
-  std::cout << "( FOR "+ id + " = ";
+  std::cout << "( FOR " << typedName(TypedName{id, type}) << " = ";
   init->visit();
   std::cout << ", ";
   exp->visit();
@@ -497,11 +1535,46 @@ void ForExprAST::visit() {
     step->visit();
   else
     std::cout << "1";
+  visitHints(hints);
   std::cout << " IN ";
   stmt->visit();
   std::cout << " END )";
 };
 
+void ForExprAST::hash(MD5 &H) {
+  H.update("f");
+  hashTyped(H, TypedName{id, type});
+  init->hash(H);
+  exp->hash(H);
+  hashOpt(H, step);
+  stmt->hash(H);
+  hashHints(H, hints);
+};
+
+// Il numero di iterazioni non è noto: il ciclo può non terminare
+void ForExprAST::effects(EffectScan &S) {
+  S.fx.diverges = true;
+  init->effects(S);
+  S.bind(id);
+  exp->effects(S);
+  if (step)
+    step->effects(S);
+  stmt->effects(S);
+  S.unbind(id);
+};
+
+// La variabile del for è legata in condizione, step e corpo (non nell'inizializzazione)
+ExprAST *ForExprAST::fold(Simplifier &S) {
+  init = init->fold(S);
+  S.bind(id);
+  exp = exp->fold(S);
+  if (step)
+    step = step->fold(S);
+  stmt = stmt->fold(S);
+  S.unbind(id);
+  return this;
+};
+
 Value *ForExprAST::codegen(driver &drv) {
   // Verifico che non sia un istruzione di tipo top
   if(gettop()) {
@@ -513,19 +1586,25 @@ Value *ForExprAST::codegen(driver &drv) {
     Function *TheFunction = drv.builder->GetInsertBlock()->getParent();
 
     //Alloca nell' entry BB le varibili che utilizziamo
-    AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, id);
+    AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, id->name, llvmType(drv, type));
 
     // Codegen di StartVal, se uguale nullptr ritorno nullptr
     Value *StartVal = init->codegen(drv);
     if (!StartVal)
       return nullptr;
     
-    // Faccio la "store"
+    // Faccio la "store" (nel tipo del contatore)
+    StartVal = convert(drv, StartVal, Alloca->getAllocatedType());
+    if (!StartVal)
+      return nullptr;
     drv.builder->CreateStore(StartVal, Alloca);
 
     // GetInsertBlock restituisce il BB dove è stata inserita la Store
     BasicBlock *PreheaderBB = drv.builder->GetInsertBlock();
     
+    // Ultimo blocco prima del loop: i blocchi successivi appartengono al loop
+    BasicBlock *LastBB = &TheFunction->back();
+
     // Basicblock creato per generare l'header, senza questo il for sarebbe un do-while fa lameno 1 iterazione senza controllare la condizione
     BasicBlock *HeaderBB = BasicBlock::Create(*drv.context, "HEADER", TheFunction);
     BasicBlock *LoopBB = BasicBlock::Create(*drv.context, "LOOP", TheFunction);
@@ -544,30 +1623,34 @@ Value *ForExprAST::codegen(driver &drv) {
     Variable->addIncoming(ConstantFP::get(*drv.context, APFloat(0.0)), PreheaderBB);
 
     // Se nella definizione della variabile del "for" vado a sovrascrivere una precedente dichiarazione esterna al
-    // loop della stessa varibiale allora devo memorizzare il precedente valore, mettendo temporaneamente la vecchia definizione
-    // nella tabella dei simboli (shadowed variable)
+    // loop della stessa varibiale, la vecchia definizione viene oscurata nello scope del loop (shadowed variable)
+    // e ripristinata alla sua chiusura
 
     // Es: int i = 10; ... for(i = 0, ...) { ... }
-    AllocaInst *OldValue = drv.NamedValues[id]; // Salvo il valore della variabile esterna al loop in OldValue
-    drv.NamedValues[id] = Alloca; // Sovrascrivo la tabella dei simboli, con variabile definita internamente al "for"
+    drv.NamedValues.push();
+    drv.NamedValues.bind(id, Alloca); // Variabile definita internamente al "for"
 
     // Codegen della condizione di terminazione, solito controllo
     Value *EndCond = exp->codegen(drv);
     if (!EndCond)
       return nullptr;
 
-    // Converto il valore inserito in tipo float
-    if (EndCond->getType()->isDoubleTy())
-      EndCond = drv.builder->CreateFCmpONE(EndCond, ConstantFP::get(*drv.context, APFloat(0.0)), "loopcond");
-      
+    // Se la condizione non è già un booleano la confronto con zero
+    EndCond = toCondition(drv, EndCond, "loopcond");
+    if (!EndCond)
+      return nullptr;
+
     // Genero una condizione di salto che dipende dalla codegen di End
     drv.builder->CreateCondBr(EndCond, LoopBB, AfterBB);
 
     // Definisco punto di inserimento delle istruzione nel blocco LoopBB
     drv.builder->SetInsertPoint(LoopBB);
 
-    // codegen del corpo del ciclo
+    // codegen del corpo del ciclo; il valore del for è sempre un double
     Value *BodyValue = stmt->codegen(drv);
+    if (!BodyValue)
+      return nullptr;
+    BodyValue = convert(drv, BodyValue, Variable->getType());
     if (!BodyValue)
       return nullptr;
 
@@ -588,14 +1671,22 @@ Value *ForExprAST::codegen(driver &drv) {
     // Carico tramite load il valore attuale dell'indice
     Value *CurVar = drv.builder->CreateLoad(Alloca->getAllocatedType(), Alloca, "loadCurrentVar");
 
-    // Vi effettuo un operazione di somma con il valore dello Step
-    Value *NextVar = drv.builder->CreateFAdd(CurVar, StepVal, "nextVarCalcolated");
+    // Vi effettuo un operazione di somma con il valore dello Step, intera se
+    // lo sono contatore e step (anche uno step costante con valore intero)
+    Type *T = commonType(drv, CurVar, StepVal);
+    CurVar = convert(drv, CurVar, T);
+    StepVal = convert(drv, StepVal, T);
+    if (!StepVal)
+      return nullptr;
+    Value *NextVar = T->isIntegerTy() ? drv.builder->CreateNSWAdd(CurVar, StepVal, "nextVarCalcolated")
+                                      : drv.builder->CreateFAdd(CurVar, StepVal, "nextVarCalcolated");
 
     // Salvo il risultato tramite una store
-    drv.builder->CreateStore(NextVar, Alloca);
+    drv.builder->CreateStore(convert(drv, NextVar, Alloca->getAllocatedType()), Alloca);
 
     // Genero un salto per tornare all'header e verificare nuovamente la condizione
-    drv.builder->CreateBr(HeaderBB);
+    BranchInst *BackEdge = drv.builder->CreateBr(HeaderBB);
+    addLoopMetadata(drv, BackEdge, hints, LastBB);
 
     // Il codegen del body potrebbe aver creato altri blocchi o alterato il blocco su cui stiamo lavorando
     BasicBlock *bodyExitBB = drv.builder->GetInsertBlock();
@@ -607,19 +1698,248 @@ Value *ForExprAST::codegen(driver &drv) {
     drv.builder->SetInsertPoint(AfterBB);
     
     // Ripristina il valore della variabile esterna al loop che potrebbe essere stata sovrascritta
-    if (OldValue)
-      drv.NamedValues[id] = OldValue;
-
-    else
-      drv.NamedValues.erase(id);
+    drv.NamedValues.pop();
 
     // Ritorno il nodo PHI
     return Variable;
   }
 }
 
+/************************* Parfor **************************/
+ParForExprAST::ParForExprAST(TypedName id, ExprAST* init, ExprAST* end, ExprAST* step, ExprAST* stmt) :
+  id(id.name),
+  type(id.type),
+  init(std::move(init)),
+  end(std::move(end)),
+  step(std::move(step)),
+  stmt(std::move(stmt))
+  {top = false;}
+
+void ParForExprAST::visit() {
+  std::cout << "( PARFOR " << typedName(TypedName{id, type}) << " = ";
+  init->visit();
+  std::cout << ", ";
+  end->visit();
+  std::cout << " , ";
+  if(step)
+    step->visit();
+  else
+    std::cout << "1";
+  std::cout << " IN ";
+  stmt->visit();
+  std::cout << " END )";
+};
+
+void ParForExprAST::hash(MD5 &H) {
+  H.update("p");
+  hashTyped(H, TypedName{id, type});
+  init->hash(H);
+  end->hash(H);
+  hashOpt(H, step);
+  stmt->hash(H);
+};
+
+// Il numero di iterazioni è fissato all'ingresso: il parfor termina se
+// termina il corpo
+// Il parfor chiama kfe_parfor, che usa lo stato globale del runtime e
+// scrive attraverso l'ambiente: come la chiamata di un extern
+void ParForExprAST::effects(EffectScan &S) {
+  S.fx.unknown = true;
+  init->effects(S);
+  end->effects(S);
+  if (step)
+    step->effects(S);
+  S.bind(id);
+  stmt->effects(S);
+  S.unbind(id);
+};
+
+// Estremi e passo sono valutati fuori dallo scope della variabile del parfor
+ExprAST *ParForExprAST::fold(Simplifier &S) {
+  init = init->fold(S);
+  end = end->fold(S);
+  if (step)
+    step = step->fold(S);
+  S.bind(id);
+  stmt = stmt->fold(S);
+  S.unbind(id);
+  return this;
+};
+
+// Valori di un'altra funzione (il chiamante, o una funzione che lo racchiude)
+// usati dal corpo estratto di un parfor
+static void outsideValues(Function *Out, SmallSetVector<Value*, 8> &Values) {
+  for (Instruction &I : instructions(Out))
+    for (Value *Op : I.operands()) {
+      if (auto *OpI = dyn_cast<Instruction>(Op)) {
+        if (OpI->getFunction() != Out)
+          Values.insert(Op);
+      } else if (auto *Arg = dyn_cast<Argument>(Op)) {
+        if (Arg->getParent() != Out)
+          Values.insert(Op);
+      }
+    }
+}
+
+// Il corpo viene generato in una funzione interna
+//   double corpo(i8* env, i64 lo, i64 hi)
+// che esegue le iterazioni di indice [lo, hi) e ne somma i valori; il runtime
+// (kfe_parfor) divide gli indici tra i thread. Durante il codegen del corpo i
+// nomi restano legati alle alloca del chiamante: le variabili usate vengono
+// poi trovate tra gli operandi e passate nell'ambiente (env). Le variabili
+// scalari sono copiate e reinizializzate a ogni iterazione (le assegnazioni
+// nel corpo restano private); gli array locali sono condivisi
+Value *ParForExprAST::codegen(driver &drv) {
+  if(gettop())
+    return TopExpression(this, drv);
+
+  LLVMContext &C = *drv.context;
+  IRBuilder<> &B = *drv.builder;
+  Type *I64 = Type::getInt64Ty(C);
+  Type *Dbl = Type::getDoubleTy(C);
+  Type *I8P = Type::getInt8PtrTy(C);
+
+  // Estremi e passo vengono valutati una sola volta, come interi
+  Value *Lo = init->codegen(drv);
+  if (!Lo || !(Lo = convert(drv, Lo, I64)))
+    return nullptr;
+  Value *Hi = end->codegen(drv);
+  if (!Hi || !(Hi = convert(drv, Hi, I64)))
+    return nullptr;
+  Value *Step = step ? step->codegen(drv) : ConstantInt::get(I64, 1);
+  if (!Step || !(Step = convert(drv, Step, I64)))
+    return nullptr;
+
+  Function *Caller = B.GetInsertBlock()->getParent();
+  IRBuilderBase::InsertPoint CallerIP = B.saveIP();
+
+  FunctionType *BodyTy = FunctionType::get(Dbl, {I8P, I64, I64}, false);
+  Function *Out = Function::Create(BodyTy, Function::InternalLinkage,
+                                   Caller->getName() + ".parfor", drv.module);
+  Argument *EnvArg = Out->getArg(0), *First = Out->getArg(1), *Last = Out->getArg(2);
+  EnvArg->setName("env");
+  First->setName("lo");
+  Last->setName("hi");
+  Out->addFnAttr(Attribute::NoUnwind);
+  Out->addParamAttr(0, Attribute::NoCapture);
+  Out->addParamAttr(0, Attribute::ReadOnly);
+  fastMathAttributes(Out, B.getFastMathFlags());
+
+  BasicBlock *EntryBB = BasicBlock::Create(C, "entry", Out);
+  BasicBlock *LoopBB = BasicBlock::Create(C, "PARLOOP", Out);
+  B.SetInsertPoint(LoopBB);
+  PHINode *K = B.CreatePHI(I64, 2, "k");
+  PHINode *Sum = B.CreatePHI(Dbl, 2, "sum");
+  AllocaInst *Counter = CreateEntryBlockAlloca(drv, Out, id->name, llvmType(drv, type));
+
+  drv.NamedValues.push();
+  drv.NamedValues.bind(id, Counter);
+  Value *BodyValue = stmt->codegen(drv);
+  drv.NamedValues.pop();
+  if (BodyValue)
+    BodyValue = convert(drv, BodyValue, Dbl);
+  if (!BodyValue) {
+    Out->eraseFromParent();
+    B.restoreIP(CallerIP);
+    return nullptr;
+  }
+
+  Value *SumNext = B.CreateFAdd(Sum, BodyValue, "sumnext");
+  Value *KNext = B.CreateNSWAdd(K, ConstantInt::get(I64, 1), "knext");
+  BasicBlock *LatchBB = B.GetInsertBlock();
+  BasicBlock *ExitBB = BasicBlock::Create(C, "PAREXIT", Out);
+  B.CreateCondBr(B.CreateICmpSLT(KNext, Last), LoopBB, ExitBB);
+  K->addIncoming(First, EntryBB);
+  K->addIncoming(KNext, LatchBB);
+  Sum->addIncoming(ConstantFP::get(Dbl, 0.0), EntryBB);
+  Sum->addIncoming(SumNext, LatchBB);
+  B.SetInsertPoint(ExitBB);
+  PHINode *Result = B.CreatePHI(Dbl, 2, "result");
+  Result->addIncoming(ConstantFP::get(Dbl, 0.0), EntryBB);
+  Result->addIncoming(SumNext, LatchBB);
+  B.CreateRet(Result);
+
+  // Ambiente: inizio e passo, seguiti dai valori catturati
+  SmallSetVector<Value*, 8> Captured;
+  outsideValues(Out, Captured);
+  std::vector<Type*> Fields = {I64, I64};
+  for (Value *V : Captured) {
+    auto *A = dyn_cast<AllocaInst>(V);
+    Fields.push_back(A && !A->getAllocatedType()->isArrayTy() ? A->getAllocatedType() : V->getType());
+  }
+  StructType *EnvTy = StructType::get(C, Fields);
+
+  B.SetInsertPoint(EntryBB);
+  Value *Env = B.CreateBitCast(EnvArg, PointerType::getUnqual(EnvTy), "envp");
+  auto Field = [&](unsigned I, const Twine &Name) {
+    return B.CreateLoad(Fields[I], B.CreateStructGEP(EnvTy, Env, I), Name);
+  };
+  Value *Start = Field(0, "start");
+  Value *Stride = Field(1, "step");
+  std::vector<std::pair<Value*, AllocaInst*>> Copies;
+  for (unsigned I = 0, E = Captured.size(); I != E; ++I) {
+    Value *V = Captured[I];
+    Value *Inner = Field(I + 2, V->getName());
+    auto *A = dyn_cast<AllocaInst>(V);
+    if (A && !A->getAllocatedType()->isArrayTy()) {
+      AllocaInst *Copy = CreateEntryBlockAlloca(drv, Out, A->getName(), A->getAllocatedType());
+      Copies.emplace_back(Inner, Copy);
+      Inner = Copy;
+    }
+    for (Use &U : make_early_inc_range(V->uses()))
+      if (cast<Instruction>(U.getUser())->getFunction() == Out)
+        U.set(Inner);
+  }
+  B.CreateCondBr(B.CreateICmpSLT(First, Last), LoopBB, ExitBB);
+
+  // All'inizio di ogni iterazione: valore del contatore e copie delle variabili
+  B.SetInsertPoint(LoopBB, LoopBB->getFirstInsertionPt());
+  Value *Index = B.CreateAdd(Start, B.CreateMul(K, Stride), "i");
+  B.CreateStore(convert(drv, Index, Counter->getAllocatedType()), Counter);
+  for (auto &Copy : Copies)
+    B.CreateStore(Copy.first, Copy.second);
+
+  bool Broken;
+  {
+    PhaseScope Verify(drv.timer, Phase::Verify, "VerifyFunction", Out->getName());
+    Broken = verifyFunction(*Out, &errs());
+  }
+  B.restoreIP(CallerIP);
+  if (Broken) {
+    Out->eraseFromParent();
+    return LogErrorV("Errore: corpo del parfor malformato");
+  }
+  if (drv.print_ir) {
+    Out->print(errs());
+    errs() << "\n";
+  }
+  drv.outlined.push_back(Out);
+
+  // Nel chiamante: ambiente e numero di iterazioni, ceil((hi - lo) / step),
+  // nullo se l'intervallo è vuoto o il passo non è positivo
+  AllocaInst *EnvAlloca = CreateEntryBlockAlloca(drv, Caller, "env", EnvTy);
+  B.CreateStore(Lo, B.CreateStructGEP(EnvTy, EnvAlloca, 0));
+  B.CreateStore(Step, B.CreateStructGEP(EnvTy, EnvAlloca, 1));
+  for (unsigned I = 0, E = Captured.size(); I != E; ++I) {
+    Value *V = Captured[I];
+    auto *A = dyn_cast<AllocaInst>(V);
+    if (A && !A->getAllocatedType()->isArrayTy())
+      V = B.CreateLoad(A->getAllocatedType(), A, A->getName());
+    B.CreateStore(V, B.CreateStructGEP(EnvTy, EnvAlloca, I + 2));
+  }
+  Value *One = ConstantInt::get(I64, 1);
+  Value *Valid = B.CreateAnd(B.CreateICmpSLT(Lo, Hi), B.CreateICmpSGT(Step, ConstantInt::get(I64, 0)));
+  Value *Span = B.CreateSub(B.CreateSub(Hi, Lo), One);
+  Value *Count = B.CreateAdd(B.CreateUDiv(Span, B.CreateSelect(Valid, Step, One)), One);
+  Count = B.CreateSelect(Valid, Count, ConstantInt::get(I64, 0), "count");
+
+  FunctionCallee Runtime = drv.module->getOrInsertFunction(
+      "kfe_parfor", FunctionType::get(Dbl, {PointerType::getUnqual(BodyTy), I8P, I64}, false));
+  return B.CreateCall(Runtime, {Out, B.CreateBitCast(EnvAlloca, I8P), Count}, "parfor");
+}
+
 /************************* Estensione 4 **************************/
-VarExprAST::VarExprAST(std::vector<std::pair<std::string, ExprAST*>> varNames, ExprAST* exp) :
+VarExprAST::VarExprAST(std::vector<std::pair<TypedName, ExprAST*>> varNames, ExprAST* exp) :
   varNames(std::move(varNames)),
   exp(std::move(exp))
   {top = false;}
@@ -628,9 +1948,9 @@ void VarExprAST::visit() {
   std::cout<<"( ";
   for (unsigned i = 0, e = varNames.size(); i != e; ++i)
   {
-    const std::string &VarName = varNames[i].first;
+    const TypedName &VarName = varNames[i].first;
     ExprAST *Init = varNames[i].second;
-    std::cout<<VarName;
+    std::cout<<typedName(VarName);
     if(Init)
     {
       std::cout<<" = ";
@@ -643,21 +1963,77 @@ void VarExprAST::visit() {
   std::cout << " END )";
 };
 
+void VarExprAST::hash(MD5 &H) {
+  H.update("V");
+  hashInt(H, varNames.size());
+  for (auto &V : varNames) {
+    hashTyped(H, V.first);
+    hashOpt(H, V.second);
+  }
+  exp->hash(H);
+};
+
+void VarExprAST::effects(EffectScan &S) {
+  for (auto &V : varNames) {
+    if (V.second)
+      V.second->effects(S);
+    S.bind(V.first.name);
+  }
+  exp->effects(S);
+  for (auto &V : varNames)
+    S.unbind(V.first.name);
+};
+
+// Ogni variabile è legata a partire dall'inizializzatore successivo
+ExprAST *VarExprAST::fold(Simplifier &S) {
+  for (auto &V : varNames) {
+    if (V.second)
+      V.second = V.second->fold(S);
+    S.bind(V.first.name);
+  }
+  exp = exp->fold(S);
+  for (auto &V : varNames)
+    S.unbind(V.first.name);
+  return this;
+};
+
+bool VarExprAST::pure(Simplifier &S) {
+  bool Pure = true;
+  for (auto &V : varNames) {
+    Pure = Pure && (!V.second || V.second->pure(S));
+    S.bind(V.first.name);
+  }
+  Pure = Pure && exp->pure(S);
+  for (auto &V : varNames)
+    S.unbind(V.first.name);
+  return Pure;
+};
+
 Value *VarExprAST::codegen(driver &drv) {
   // Verifico che non sia un istruzione di tipo top
   if(gettop()) {
     return TopExpression(this, drv);
 
   } else {
-    std::vector<AllocaInst *> OldBindings;
-
     Function *TheFunction = drv.builder->GetInsertBlock()->getParent();
 
     // Registra tutte le variabili ed emette il loro inizializzatore.
+    // Le variabili esterne con lo stesso nome vengono oscurate nello scope del var
+    drv.NamedValues.push();
     for (unsigned i = 0, e = varNames.size(); i != e; ++i) {
-      const std::string &varName = varNames[i].first;
+      Symbol *varName = varNames[i].first.name;
+      Type *VarTy = llvmType(drv, varNames[i].first);
       ExprAST *Init = varNames[i].second;
 
+      // Gli array locali sono allocati nel blocco di ingresso e azzerati
+      if (auto *AT = dyn_cast<ArrayType>(VarTy)) {
+        AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, varName->name, AT);
+        drv.builder->CreateMemSet(Alloca, drv.builder->getInt8(0),
+                                  drv.module->getDataLayout().getTypeAllocSize(AT), Alloca->getAlign());
+        drv.NamedValues.bind(varName, Alloca);
+        continue;
+      }
+
       // var a = 1 in
       //    var a = a in ...  <-- si riferisce alla 'a' esterna.
       Value *InitVal;
@@ -668,16 +2044,17 @@ Value *VarExprAST::codegen(driver &drv) {
           return nullptr;
 
       } else  // Se non è specificato il valore iniziale, lo inizializzo a 0
-          InitVal = ConstantFP::get(*drv.context, APFloat(0.0));
+          InitVal = Constant::getNullValue(VarTy);
 
-      AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, varName);
-      drv.builder->CreateStore(InitVal, Alloca);
+      InitVal = convert(drv, InitVal, VarTy);
+      if (!InitVal)
+        return nullptr;
 
-      // Tengo traccia degli attuali valori delle variabili inizializzate esternamente al loop
-      OldBindings.push_back(drv.NamedValues[varName]);
+      AllocaInst *Alloca = CreateEntryBlockAlloca(drv, TheFunction, varName->name, VarTy);
+      drv.builder->CreateStore(InitVal, Alloca);
 
       // Sovrascrivo nella tabella dei simboli il valore della variabile inizializzata internamente al loop
-      drv.NamedValues[varName] = Alloca;
+      drv.NamedValues.bind(varName, Alloca);
     }
 
     // Genero il codice ora che ho tutte le variabili inizializzate
@@ -686,9 +2063,8 @@ Value *VarExprAST::codegen(driver &drv) {
     if (!expVal)
       return nullptr;
 
-    // Aggiorno la tabella dei simboli con i valori delle variabili esterne al loop
-    for (unsigned i = 0, e = varNames.size(); i != e; ++i)
-      drv.NamedValues[varNames[i].first] = OldBindings[i];
+    // Ripristino nella tabella dei simboli le variabili esterne
+    drv.NamedValues.pop();
 
     // Ritorno il valore dell'espressione
     return expVal;
@@ -696,19 +2072,40 @@ Value *VarExprAST::codegen(driver &drv) {
 }
 
 /************************* Estensione 5 **************************/
-WhileExprAST::WhileExprAST(ExprAST* end, ExprAST* exp) :
+WhileExprAST::WhileExprAST(ExprAST* end, ExprAST* exp, LoopHints hints) :
   end(std::move(end)),
-  exp(std::move(exp))
+  exp(std::move(exp)),
+  hints(hints)
   {top=false;}
 
 void WhileExprAST::visit() {
   std::cout << "( WHILE ";
   end->visit();
+  visitHints(hints);
   std::cout << " IN ";
   exp->visit();
   std::cout << " END )";
 };
 
+void WhileExprAST::hash(MD5 &H) {
+  H.update("w");
+  end->hash(H);
+  exp->hash(H);
+  hashHints(H, hints);
+};
+
+void WhileExprAST::effects(EffectScan &S) {
+  S.fx.diverges = true;
+  end->effects(S);
+  exp->effects(S);
+};
+
+ExprAST *WhileExprAST::fold(Simplifier &S) {
+  end = end->fold(S);
+  exp = exp->fold(S);
+  return this;
+};
+
 Value *WhileExprAST::codegen(driver& drv) {
   if(gettop()) {
     return TopExpression(this, drv);
@@ -717,6 +2114,7 @@ Value *WhileExprAST::codegen(driver& drv) {
 
     // Crea i nuovi BB per la gestione del while
     BasicBlock *PreheaderBB = drv.builder->GetInsertBlock();
+    BasicBlock *LastBB = &TheFunction->back(); // I blocchi successivi appartengono al loop
     BasicBlock *WhileBB = BasicBlock::Create(*drv.context, "WHILE", TheFunction);
     BasicBlock *HeaderBB = BasicBlock::Create(*drv.context, "HEADERWHILE", TheFunction); // Basicblock creato per generare l'header, senza questo il for sarebbe un do-while fa lameno 1 iterazione senza controllare la condizione
     BasicBlock *AfterBB = BasicBlock::Create(*drv.context, "AFTERWHILE", TheFunction);
@@ -737,9 +2135,10 @@ Value *WhileExprAST::codegen(driver& drv) {
     if (!EndCond)
       return nullptr;
 
-    // Come per l'if controllo se è double e lo gestisco
-    if (EndCond->getType()->isDoubleTy())
-      EndCond = drv.builder->CreateFCmpONE(EndCond, ConstantFP::get(*drv.context, APFloat(0.0)), "loopcond");
+    // Come per l'if, se non è già un booleano la confronto con zero
+    EndCond = toCondition(drv, EndCond, "loopcond");
+    if (!EndCond)
+      return nullptr;
 
     // Genero una condizione di salto che dipende dalla codegen di End
     drv.builder->CreateCondBr(EndCond, WhileBB, AfterBB);
@@ -750,17 +2149,119 @@ Value *WhileExprAST::codegen(driver& drv) {
     
     // Codegen della condizione di terminazione, solito controllo
     Value *BodyValue = exp->codegen(drv);
+    if (!BodyValue)
+      return nullptr;
+    BodyValue = convert(drv, BodyValue, Variable->getType()); // Il valore del while è sempre un double
     if (!BodyValue)
       return nullptr;
 
-    drv.builder->CreateBr(HeaderBB);
+    BranchInst *BackEdge = drv.builder->CreateBr(HeaderBB);
+    addLoopMetadata(drv, BackEdge, hints, LastBB);
+
+    // Il codegen del body potrebbe aver creato altri blocchi (loop o if annidati)
+    BasicBlock *bodyExitBB = drv.builder->GetInsertBlock();
 
     // Aggiunge una nuova voce al nodo PHI per il backedge.
-    Variable->addIncoming(BodyValue, WhileBB);
+    Variable->addIncoming(BodyValue, bodyExitBB);
 
      // Imposto come punto di inserimento il blocco AfterBB, così le prossime istruzioni vengono messe in tale blocco
     drv.builder->SetInsertPoint(AfterBB);
 
     return Variable;
   }
-}
\ No newline at end of file
+}
+/**************************** Array ******************************/
+IndexExprAST::IndexExprAST(Symbol *Name, ExprAST *Index, ExprAST *Val) :
+  Name(Name), Index(Index), Val(Val) { top = false; }
+
+void IndexExprAST::visit() {
+  std::cout << "( " << Name->name.str() << "[ ";
+  Index->visit();
+  std::cout << "]";
+  if (Val) {
+    std::cout << " = ";
+    Val->visit();
+  }
+  std::cout << " )";
+};
+
+void IndexExprAST::hash(MD5 &H) {
+  H.update("[");
+  hashName(H, Name);
+  Index->hash(H);
+  hashOpt(H, Val);
+};
+
+// Solo gli accessi tramite un parametro puntatore sono visibili al chiamante
+void IndexExprAST::effects(EffectScan &S) {
+  Index->effects(S);
+  if (Val)
+    Val->effects(S);
+  if (S.pointer(Name))
+    (Val ? S.fx.writes : S.fx.reads) = true;
+};
+
+// Le letture non sono pure (la memoria può cambiare): il nodo non viene mai condiviso
+ExprAST *IndexExprAST::fold(Simplifier &S) {
+  Index = Index->fold(S);
+  if (Val)
+    Val = Val->fold(S);
+  return this;
+};
+
+// Indirizzo dell'elemento: GEP inbounds nell'array locale o a partire dal
+// puntatore ricevuto come parametro. Con un array locale e un indice
+// costante i limiti vengono controllati durante la compilazione
+Value *IndexExprAST::address(driver &drv, Type *&ElemTy) {
+  AllocaInst *A = drv.NamedValues.lookup(Name);
+  if (!A)
+    return LogErrorV("Unknown variable name");
+
+  Value *Idx = Index->codegen(drv);
+  if (!Idx)
+    return nullptr;
+  Idx = convert(drv, Idx, Type::getInt64Ty(*drv.context)); // Indice intero, come in C
+  if (!Idx)
+    return nullptr;
+
+  Type *T = A->getAllocatedType();
+  if (auto *AT = dyn_cast<ArrayType>(T)) {
+    ElemTy = AT->getElementType();
+    if (auto *C = dyn_cast<ConstantInt>(Idx))
+      if (C->getValue().uge(AT->getNumElements()))
+        return LogErrorV("Indice " + std::to_string(C->getSExtValue()) + " fuori dai limiti dell'array " +
+                         Name->name.str() + "[" + std::to_string(AT->getNumElements()) + "]");
+    return drv.builder->CreateInBoundsGEP(AT, A, {drv.builder->getInt64(0), Idx}, "elemaddr");
+  }
+  if (T->isPointerTy()) {
+    ElemTy = T->getPointerElementType();
+    Value *Ptr = drv.builder->CreateLoad(T, A, Name->name);
+    return drv.builder->CreateInBoundsGEP(ElemTy, Ptr, Idx, "elemaddr");
+  }
+  return LogErrorV(Name->name.str() + " non è un array");
+}
+
+Value *IndexExprAST::codegen(driver &drv) {
+  if (gettop())
+    return TopExpression(this, drv);
+
+  Type *ElemTy;
+  Value *Addr = address(drv, ElemTy);
+  if (!Addr)
+    return nullptr;
+
+  // Lettura: "load" dell'elemento
+  if (!Val)
+    return drv.builder->CreateLoad(ElemTy, Addr, Name->name + "elem");
+
+  // Scrittura: il valore viene convertito nel tipo degli elementi
+  Value *V = Val->codegen(drv);
+  if (!V)
+    return nullptr;
+  V = convert(drv, V, ElemTy);
+  if (!V)
+    return nullptr;
+  drv.builder->CreateStore(V, Addr);
+  drv.stores++;
+  return V;
+}
@@ -1,17 +1,25 @@
 #ifndef DRIVER_HH
 #define DRIVER_HH
 /************ Header file per la generazione del codice oggetto *************/
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 /***************************************************************************/
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -21,10 +29,14 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/Allocator.h"
 #include <algorithm>
+#include <chrono>
 #include <cctype>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -36,34 +48,277 @@ using namespace llvm;
 
 // Dichiarazione del prototipo yylex per Flex
 // Flex va proprio a cercare YY_DECL perché
-// deve espanderla (usando M4) nel punto appropriato
+// deve espanderla (usando M4) nel punto appropriato.
+// Lo scanner è rientrante: yyscanner è il suo stato (yyscan_t)
 # define YY_DECL \
-  yy::parser::symbol_type yylex (driver& drv)
+  yy::parser::symbol_type yylex (driver& drv, void* yyscanner)
 // Per il parser è sufficiente una forward declaration
 YY_DECL;
 
+// Arena (bump allocator) in cui vengono allocati tutti i nodi dell'AST.
+// I nodi non vengono mai liberati singolarmente: reset() invoca i
+// distruttori e rilascia in un colpo solo tutta la memoria dell'arena
+class ASTArena {
+private:
+  BumpPtrAllocator Alloc;
+  std::vector<RootAST*> Nodes; // Nodi allocati, per invocarne i distruttori
+  size_t Total = 0;            // Nodi allocati prima dell'ultimo reset
+  size_t Peak = 0;             // Massima occupazione raggiunta (byte)
+
+public:
+  ~ASTArena() { reset(); };
+  template <typename T, typename... Args> T *make(Args&&... args) {
+    T *N = new (Alloc.Allocate<T>()) T(std::forward<Args>(args)...);
+    Nodes.push_back(N);
+    return N;
+  }
+  void reset();
+  size_t nodes() const { return Nodes.size(); };
+  size_t bytes() const { return Alloc.getBytesAllocated(); };
+  size_t reserved() const { return Alloc.getTotalMemory(); };
+  // Statistiche complessive, anche attraverso più reset (streaming)
+  size_t total() const { return Total + nodes(); };
+  size_t peak() const { return std::max(Peak, bytes()); };
+  void resetStats() { Total = 0; Peak = 0; };
+};
+
+// Identificatore internato: lo scanner trasforma ogni nome in un Symbol una
+// sola volta, AST e tabelle dei simboli lavorano poi sui puntatori/ID
+// senza copiare o confrontare stringhe
+struct Symbol {
+  StringRef name;     // Nome (memorizzato nell'Interner)
+  unsigned id;        // Indice compatto, progressivo
+  // Funzione con questo nome nel modulo corrente (risolta una sola volta),
+  // valida solo se fnGen coincide con la generazione del modulo del driver
+  Function *fn = nullptr;
+  unsigned fnGen = 0;
+  // Prototipo registrato, usato per ridichiarare la funzione nei moduli
+  // creati successivamente (modalità JIT). È una copia perché l'AST
+  // viene liberato al termine di ogni codegen
+  std::unique_ptr<PrototypeAST> proto;
+};
+
+class Interner {
+private:
+  StringMap<Symbol*> Map;
+  std::deque<Symbol> Symbols; // Indirizzi stabili, indicizzati per ID
+
+public:
+  Symbol *intern(StringRef Name);
+  size_t size() const { return Symbols.size(); };
+};
+
+// Tabella dei simboli a scope. Il binding corrente di ogni simbolo è in un
+// vettore indicizzato per ID (lookup O(1), senza confronti di stringhe);
+// ogni bind() salva il binding oscurato in un undo log, e pop() ripristina
+// in un solo passo tutti i binding dello scope che si chiude
+class ScopedSymbolTable {
+private:
+  std::vector<AllocaInst*> Bindings;                  // Indicizzato per ID
+  std::vector<std::pair<unsigned, AllocaInst*>> Undo; // Binding oscurati
+  std::vector<size_t> Scopes;                         // Inizio di ogni scope nell'undo log
+  unsigned Version = 0;                               // Cambia a ogni bind/pop/clear
+  void rewind(size_t To);
+
+public:
+  AllocaInst *lookup(Symbol *S) const {
+    return S->id < Bindings.size() ? Bindings[S->id] : nullptr;
+  };
+  void bind(Symbol *S, AllocaInst *A);
+  void push() { Scopes.push_back(Undo.size()); };
+  void pop();
+  void clear();
+  unsigned version() const { return Version; };
+};
+
+// Stato del pass di semplificazione dell'AST, eseguito tra parsing e
+// codegen: simboli legati nello scope corrente (una variabile è pura solo
+// se è legata) e tabella di hash-consing delle sottoespressioni pure
+class Simplifier {
+private:
+  ASTArena &Arena;
+  std::map<std::tuple<char, char, const void*, const void*, uint64_t>, ExprAST*> Nodes;
+  std::vector<unsigned> Bound; // Numero di binding attivi, per ID di simbolo
+
+public:
+  Simplifier(ASTArena &Arena): Arena(Arena) {};
+  void reset();       // Inizio di un nuovo elemento top-level
+  void bind(Symbol *S);
+  void unbind(Symbol *S) { Bound[S->id]--; };
+  bool bound(Symbol *S) const { return S->id < Bound.size() && Bound[S->id]; };
+  // Restituisce il nodo già visto con la stessa chiave (marcandolo come
+  // condiviso), oppure registra E
+  ExprAST *intern(ExprAST *E, char Kind, char Op, const void *A, const void *B,
+                  uint64_t Bits = 0);
+  ExprAST *number(double Val);
+  ExprAST *boolean(bool Val); // Risultato costante di un confronto
+};
+
+// Effetti di una funzione, calcolati sull'AST del corpo e registrati nel
+// prototipo: ne derivano gli attributi (readnone, nounwind, ...) della
+// funzione e delle sue dichiarazioni nei moduli successivi
+struct Effects {
+  bool known = false;     // Funzione analizzata (false per gli extern)
+  bool reads = false;     // Legge la memoria dei parametri puntatore
+  bool writes = false;    // Scrive la memoria dei parametri puntatore
+  bool unknown = false;   // Chiama funzioni extern, con effetti qualsiasi
+  bool diverges = false;  // Può non terminare (loop, ricorsione)
+  bool recursive = false; // Chiama sé stessa
+};
+
+// Stato dell'analisi degli effetti di una definizione. Gli assegnamenti con
+// "=" e gli array locali modificano solo il frame della funzione: contano
+// gli accessi ai parametri puntatore (se non oscurati da variabili locali)
+// e gli effetti delle funzioni chiamate. Una definizione può chiamare solo
+// sé stessa o funzioni già definite, le cui chiamate sono già analizzate:
+// la ricorsione diretta è l'unico ciclo del grafo delle chiamate
+class EffectScan {
+private:
+  Symbol *Self;
+  std::vector<bool> Pointer;   // Parametri puntatore, per ID di simbolo
+  std::vector<unsigned> Bound; // Binding locali attivi, per ID di simbolo
+
+public:
+  Effects fx;
+  EffectScan(Symbol *Self, const std::vector<TypedName> &Args);
+  void bind(Symbol *S);
+  void unbind(Symbol *S) { Bound[S->id]--; };
+  bool pointer(Symbol *S) const {
+    return S->id < Pointer.size() && Pointer[S->id] && !Bound[S->id];
+  };
+  void call(Symbol *Callee);
+};
+
+// Contrazione delle operazioni in virgola mobile (-ffp-contract): mai, solo
+// all'interno di un'espressione (llvm.fmuladd) o ovunque (flag contract)
+enum class FPContract { Off, On, Fast };
+
+// Fasi della compilazione misurate con -ftime-report
+enum class Phase { Other, Scan, Parse, Simplify, Codegen, Verify, Optimize, Emit, Jit, Count };
+
+// Tempi delle fasi di compilazione. I tempi sono esclusivi: entrando in una
+// fase il tempo trascorso viene attribuito a quella interrotta, così le fasi
+// annidate (scanner nel parser, verifica nel codegen) non vengono contate due volte
+class PhaseTimer {
+private:
+  using Clock = std::chrono::steady_clock;
+  double Seconds[(int)Phase::Count] = {};
+  Phase Current = Phase::Other;
+  Clock::time_point Since = Clock::now();
+  void charge();
+
+public:
+  bool enabled = false;
+  Phase enter(Phase P); // Restituisce la fase interrotta
+  void leave(Phase Prev);
+  void report(raw_ostream &OS, StringRef Name);
+};
+
+// Misura una fase per la durata dello scope e, con -ftime-trace, ne registra
+// lo span (Name, Detail) nella traccia del profiler di LLVM
+class PhaseScope {
+private:
+  PhaseTimer &Timer;
+  Phase Prev;
+  TimeTraceScope Trace;
+
+public:
+  PhaseScope(PhaseTimer &T, Phase P, StringRef Name, StringRef Detail = "")
+    : Timer(T), Prev(T.enter(P)), Trace(Name, Detail) {};
+  ~PhaseScope() { Timer.leave(Prev); };
+};
+
 // Classe che organizza e gestisce il processo di compilazione
 class driver
 {
 public:
   driver();
+  ~driver();
   LLVMContext *context;
   Module *module;
   IRBuilder<> *builder;
-  std::map<std::string, AllocaInst *> NamedValues;
-  static inline int Cnt=0; //Contatore incrementale, per identificare registri SSA
+  ScopedSymbolTable NamedValues;
+  Interner symbols;   // Identificatori internati
+  int Cnt;            // Contatore incrementale, per identificare registri SSA
   RootAST* root;      // A fine parsing "punta" alla radice dell'AST
   int parse (const std::string& f);
+  int parse_string (const std::string& src, const std::string& name);
+  bool scan (const std::string& f, size_t& tokens); // Solo analisi lessicale (benchmark)
   std::string file;
   bool trace_parsing; // Abilita le tracce di debug el parser
-  void scan_begin (); // Implementata nello scanner
+  bool scan_begin (); // Implementata nello scanner; true se il file non è leggibile
   void scan_end ();   // Implementata nello scanner
+  void *scanner;      // Stato dello scanner rientrante (yyscan_t)
+  bool stdio_input;   // Legge il sorgente tramite FILE* invece che da memoria
+  bool in_memory;     // Il sorgente è già in buffer (parse_string)
+  std::string buffer; // Sorgente in memoria, terminato da due caratteri nulli
+  char *mapped;       // File sorgente mappato in memoria
+  size_t mapped_size;
   bool trace_scanning;// Abilita le tracce di debug nello scanner
   yy::location location; // Utillizata dallo scannar per localizzare i token
   bool ast_print;
+  bool mem_stats;     // Stampa le statistiche di occupazione dell'arena
+  bool print_ir;      // Stampa su stderr l'IR di ogni funzione (--print-ir)
+  bool simplify;      // Semplificazione dell'AST prima del codegen (-fno-simplify la disabilita)
+  // Semantica della virgola mobile: flag fast-math delle operazioni generate
+  // (tutti attivi nelle definizioni "fastmath def") e contrazione
+  FastMathFlags fmf;
+  FPContract fp_contract;
+  bool instrumented;  // Codice strumentato per PGO (-fprofile-generate)
+  // Valori già generati per le sottoespressioni condivise (hash-consing):
+  // un valore si riusa solo nello stesso blocco, se nel frattempo non ci
+  // sono stati assegnamenti né cambi di scope
+  struct CSEEntry { Value *V; BasicBlock *BB; unsigned Scope, Stores; };
+  DenseMap<ExprAST*, CSEEntry> cse;
+  unsigned stores;    // Numero di assegnamenti generati
+  Value *cseLookup(ExprAST *E);
+  void cseRecord(ExprAST *E, Value *V);
+  PhaseTimer timer;   // Tempi delle fasi (-ftime-report)
+  ASTArena arena;     // Contiene tutti i nodi dell'AST
   void codegen();
+  unsigned moduleGen; // Generazione del modulo corrente (cambia con newModule)
+  Function *getFunction(Symbol *S);
+  void setFunction(Symbol *S, Function *F);
+  // Corpi dei parfor estratti dalla funzione in generazione, da eliminare
+  // insieme a lei (errori ed espressioni top-level fuori da --run)
+  std::vector<Function*> outlined;
+  void eraseFunction(Function *F);
+  // Modalità di esecuzione con ORC (--run): le definizioni vengono
+  // aggiunte al JIT appena prodotte e le espressioni top-level eseguite
+  bool lazy;          // Compilazione delle funzioni alla prima chiamata
+  std::unique_ptr<orc::LLLazyJIT> jit;
+  orc::ThreadSafeContext TSCtx;
+  int initJIT();
+  // Modalità streaming (--stream): ogni elemento top-level viene generato
+  // appena ridotto dal parser e il suo AST liberato subito
+  bool streaming;
+  void stream(RootAST *item);
+  // Destinazione dei moduli completati quando non si usa il JIT: se
+  // impostata, ogni definizione viene generata in un proprio modulo che
+  // le viene ceduto (es. per emetterne subito il codice macchina)
+  std::function<void(std::unique_ptr<Module>)> moduleSink;
+  // Cache delle definizioni (in streaming): riceve l'hash dell'AST di una
+  // definizione e restituisce true se il suo codice è già disponibile, nel
+  // qual caso codegen e backend vengono saltati
+  std::function<bool(StringRef Digest)> cacheLookup;
+  // Ottimizzazione (-O1..-O3) dei moduli prima di cederli al JIT
+  std::function<void(Module &M)> jitOptimize;
+  void newModule();
+  void flushModule();
+  void jitEval(const std::string &Name);
 };
 
+// Il parser invoca yylex(drv): lo stato dello scanner è quello del driver
+// (con -ftime-report il tempo dello scanner è misurato token per token)
+inline yy::parser::symbol_type yylex (driver& drv) {
+  if (!drv.timer.enabled)
+    return yylex (drv, drv.scanner);
+  Phase Prev = drv.timer.enter(Phase::Scan);
+  yy::parser::symbol_type Tok = yylex (drv, drv.scanner);
+  drv.timer.leave(Prev);
+  return Tok;
+}
+
 // Classe base dell'intera gerarchia di classi che rappresentano
 // gli elementi del programma
 class RootAST {
@@ -71,51 +326,88 @@ public:
   virtual ~RootAST() {};
   virtual void visit() {};
   virtual Value *codegen(driver& drv) { return nullptr; };
+  // Semplificazione (tra parsing e codegen): restituisce il nodo da generare
+  virtual RootAST *simplify(Simplifier &S) { return this; };
+  // Hash di una definizione per la cache: restituisce il prototipo della
+  // funzione definita, nullptr per gli elementi che non vanno in cache
+  virtual PrototypeAST *digest(MD5 &H) { return nullptr; };
 };
 
 // Classe che rappresenta la sequenza di statement
 class SeqAST : public RootAST {
 private:
-  RootAST* first;
-  RootAST* continuation;
+  std::vector<RootAST*> stmts;
 
 public:
-  SeqAST(RootAST* first, RootAST* continuation);
+  SeqAST(std::vector<RootAST*> stmts);
   void visit() override;
   Value *codegen(driver& drv) override;
+  RootAST *simplify(Simplifier &S) override;
 };
 
 /// ExprAST - Classe base per tutti i nodi espressione
 class ExprAST : public RootAST {
 protected:
   bool top;
+  bool shared = false; // Nodo riferito da più punti dell'AST (hash-consing)
+  bool tail = false;   // In posizione di coda: il codegen emette anche il ret
 public:
   virtual ~ExprAST() {};
   void toggle();
   bool gettop();
+  void share() { shared = true; };
+  bool isShared() const { return shared; };
+  // Semplificazione di un'espressione top-level
+  RootAST *simplify(Simplifier &S) override;
+  // Semplificazione di una sottoespressione: restituisce il nodo sostitutivo
+  virtual ExprAST *fold(Simplifier &S) { return this; };
+  // true se la valutazione non ha effetti collaterali
+  virtual bool pure(Simplifier &S) { return false; };
+  // true (e il valore in V) se l'espressione è una costante
+  virtual bool isConst(double &V) const { return false; };
+  // true se l'espressione è il risultato costante di un confronto (un i1)
+  virtual bool isBool() const { return false; };
+  // Aggiunge all'hash la struttura dell'espressione
+  virtual void hash(MD5 &H) = 0;
+  // Segna l'espressione come ultima valutazione del corpo di una funzione;
+  // la posizione di coda si propaga ai rami degli if e al lato destro di ':'
+  virtual void markTail() {};
+  // Aggiunge a S gli effetti dell'espressione
+  virtual void effects(EffectScan &S) = 0;
 };
 
 /// NumberExprAST - Classe per la rappresentazione di costanti numeriche
 class NumberExprAST : public ExprAST {
 private:
   double Val;
+  bool Bool; // Confronto calcolato dalla semplificazione: vale 0 o 1 ed è un i1
 
 public:
-  NumberExprAST(double Val);
+  NumberExprAST(double Val, bool Bool = false);
   void visit() override;
+  void hash(MD5 &H) override;
+  void effects(EffectScan &S) override;
   Value *codegen(driver& drv) override;
+  ExprAST *fold(Simplifier &S) override;
+  bool pure(Simplifier &S) override { return true; };
+  bool isConst(double &V) const override { V = Val; return true; };
+  bool isBool() const override { return Bool; };
 };
 
 /// VariableExprAST - Classe per la rappresentazione di riferimenti a variabili
 class VariableExprAST : public ExprAST {
 private:
-  std::string Name;
+  Symbol *Name;
 
 public:
-  VariableExprAST(std::string &Name);
-  const std::string &getName() const;
+  VariableExprAST(Symbol *Name);
+  Symbol *getName() const;
   void visit() override;
+  void hash(MD5 &H) override;
+  void effects(EffectScan &S) override;
   Value *codegen(driver& drv) override;
+  ExprAST *fold(Simplifier &S) override;
+  bool pure(Simplifier &S) override;
 };
 
 /// BinaryExprAST - Classe per la rappresentazione di operatori binary
@@ -128,38 +420,52 @@ private:
 public:
   BinaryExprAST(char Op, ExprAST* LHS, ExprAST* RHS);
   void visit() override;
+  void hash(MD5 &H) override;
+  void effects(EffectScan &S) override;
   Value *codegen(driver& drv) override;
+  ExprAST *fold(Simplifier &S) override;
+  bool pure(Simplifier &S) override;
+  void markTail() override;
 };
 
 /// CallExprAST - Classe per la rappresentazione di chiamate di funzione
 class CallExprAST : public ExprAST {
 private:
-  std::string Callee;
+  Symbol *Callee;
   std::vector<ExprAST*> Args;  // ASTs per la valutazione degli argomenti
 
 public:
-  CallExprAST(std::string Callee, std::vector<ExprAST*> Args);
+  CallExprAST(Symbol *Callee, std::vector<ExprAST*> Args);
   void visit() override;
+  void hash(MD5 &H) override;
+  void effects(EffectScan &S) override;
   Value *codegen(driver& drv) override;
+  ExprAST *fold(Simplifier &S) override;
+  void markTail() override { tail = true; };
 };
 
 /// PrototypeAST - Classe per la rappresentazione dei prototipi di funzione
-/// (nome, numero e nome dei parametri; in questo caso il tipo è implicito
-/// perché unico)
+/// (nome, numero, nome e tipo dei parametri; il tipo di ritorno è sempre double)
 class PrototypeAST : public RootAST {
 private:
-  std::string Name;
-  std::vector<std::string> Args;
+  Symbol *Name;
+  std::vector<TypedName> Args;
   bool emit;
+  Effects fx;
 
 public:
-  PrototypeAST(std::string Name, std::vector<std::string> Args);
-  const std::string &getName() const;
-  const std::vector<std::string> &getArgs() const; 
+  PrototypeAST(Symbol *Name, std::vector<TypedName> Args);
+  Symbol *getName() const;
+  const std::vector<TypedName> &getArgs() const; 
   void visit() override;
+  void hash(MD5 &H);
   Function *codegen(driver& drv) override;
+  Function *declare(driver& drv);
+  void remember();
   void noemit();
   bool emitp();
+  void setEffects(const Effects &E) { fx = E; };
+  const Effects &effects() const { return fx; };
 };
 
 /// FunctionAST - Classe che rappresenta la definizione di una funzione
@@ -168,11 +474,16 @@ private:
   PrototypeAST* Proto;
   ExprAST* Body;
   bool external;
+  bool fastmath = false; // Definita con "fastmath def"
   
 public:
   FunctionAST(PrototypeAST* Proto, ExprAST* Body);
   void visit() override;
+  void analyze();
+  void setFastMath() { fastmath = true; };
+  PrototypeAST *digest(MD5 &H) override;
   Function *codegen(driver& drv) override;
+  RootAST *simplify(Simplifier &S) override;
 };
 
 
@@ -187,7 +498,12 @@ class IfExprAST : public ExprAST {
   public:
     IfExprAST(ExprAST* condizione, ExprAST* branchTrue, ExprAST* branchFalse);
     void visit() override;
+    void hash(MD5 &H) override;
+    void effects(EffectScan &S) override;
     Value *codegen(driver& drv) override;
+    ExprAST *fold(Simplifier &S) override;
+    bool pure(Simplifier &S) override;
+    void markTail() override;
 };
 
 
@@ -200,34 +516,70 @@ class UnaryExprAST : public ExprAST {
   public:
     UnaryExprAST(char operand, ExprAST* espressione);
     void visit() override;
+    void hash(MD5 &H) override;
+    void effects(EffectScan &S) override;
     Value *codegen(driver& drv) override;
+    ExprAST *fold(Simplifier &S) override;
+    bool pure(Simplifier &S) override;
 };
 
 // *********** Estensione 3 ***********
 class ForExprAST : public ExprAST {
   private:
-    std::string id;
+    Symbol* id;
+    VarType type;
     ExprAST* init;
     ExprAST* exp;
     ExprAST* step;
     ExprAST* stmt;
+    LoopHints hints;
+
+  public:
+    ForExprAST(TypedName id, ExprAST* init, ExprAST* exp, ExprAST* step, ExprAST* stmt,
+               LoopHints hints = LoopHints());
+    void visit() override;
+    void hash(MD5 &H) override;
+    void effects(EffectScan &S) override;
+    Value *codegen(driver& drv) override;
+    ExprAST *fold(Simplifier &S) override;
+};
+
+// *********** Parfor ***********
+/// ParForExprAST - Ciclo parallelo "parfor i = a, b [, step] in corpo end":
+/// il corpo viene estratto in una funzione eseguita dal runtime su più
+/// thread, il valore è la somma dei valori del corpo
+class ParForExprAST : public ExprAST {
+  private:
+    Symbol* id;
+    VarType type;
+    ExprAST* init;
+    ExprAST* end;
+    ExprAST* step;
+    ExprAST* stmt;
 
   public:
-    ForExprAST(std::string id, ExprAST* init, ExprAST* exp, ExprAST* step, ExprAST* stmt);
+    ParForExprAST(TypedName id, ExprAST* init, ExprAST* end, ExprAST* step, ExprAST* stmt);
     void visit() override;
+    void hash(MD5 &H) override;
+    void effects(EffectScan &S) override;
     Value *codegen(driver& drv) override;
+    ExprAST *fold(Simplifier &S) override;
 };
 
 // *********** Estensione 4 ***********
 class VarExprAST : public ExprAST {
   private:
-    std::vector<std::pair<std::string, ExprAST*>> varNames;
+    std::vector<std::pair<TypedName, ExprAST*>> varNames;
     ExprAST* exp;
 
   public:
-    VarExprAST(std::vector<std::pair<std::string, ExprAST*>> varNames, ExprAST* exp);
+    VarExprAST(std::vector<std::pair<TypedName, ExprAST*>> varNames, ExprAST* exp);
     void visit() override;
+    void hash(MD5 &H) override;
+    void effects(EffectScan &S) override;
     Value *codegen(driver& drv) override;
+    ExprAST *fold(Simplifier &S) override;
+    bool pure(Simplifier &S) override;
 };
 
 // *********** Estensione 5 ***********
@@ -235,11 +587,35 @@ class WhileExprAST : public ExprAST {
 private:
   ExprAST *end;
   ExprAST *exp;
+  LoopHints hints;
+
+public:
+  WhileExprAST(ExprAST *end, ExprAST *exp, LoopHints hints = LoopHints());
+  void visit() override;
+  void hash(MD5 &H) override;
+  void effects(EffectScan &S) override;
+  Value *codegen(driver &drv) override;
+  ExprAST *fold(Simplifier &S) override;
+};
+
+// *********** Array ***********
+/// IndexExprAST - Accesso a un elemento di un array locale o di un parametro
+/// puntatore: a[i] (lettura) oppure a[i] = v (scrittura, se Val non è nullptr)
+class IndexExprAST : public ExprAST {
+private:
+  Symbol *Name;
+  ExprAST *Index;
+  ExprAST *Val;
+
+  Value *address(driver &drv, Type *&ElemTy);
 
 public:
-  WhileExprAST(ExprAST *end, ExprAST *exp);
+  IndexExprAST(Symbol *Name, ExprAST *Index, ExprAST *Val = nullptr);
   void visit() override;
+  void hash(MD5 &H) override;
+  void effects(EffectScan &S) override;
   Value *codegen(driver &drv) override;
+  ExprAST *fold(Simplifier &S) override;
 };
 
 #endif // !DRIVER_HH
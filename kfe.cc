@@ -1,10 +1,907 @@
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include "driver.hh"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Object/ArchiveWriter.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/SmallVectorMemoryBuffer.h"
+#include "llvm/Support/X86TargetParser.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+// Bitcode per la link-time optimization (-flto): nessuna, ThinLTO o completa
+enum class LTOKind { None, Thin, Full };
+
+// Opzioni della riga di comando, comuni a tutti i file da compilare
+struct Options {
+  bool trace_parsing = false;
+  bool trace_scanning = false;
+  bool ast_print = false;
+  bool mem_stats = false;
+  bool stdio_input = false; // Lettura del sorgente tramite FILE* (yyin)
+  bool scan_only = false;   // Solo analisi lessicale, con misura del throughput
+  bool parse_only = false;  // Solo parsing, con misura del throughput
+  bool stream = false;      // Codegen di ogni elemento top-level appena letto
+  bool print_ir = false;    // Stampa l'IR di ogni funzione su stderr
+  bool simplify = true;     // Semplificazione dell'AST prima del codegen
+  bool emit_obj = false;    // Artefatti da scrivere: <base>.o ...
+  bool emit_ll = false;     // ... <base>.ll (-emit-llvm)
+  bool emit_asm = false;    // ... <base>.s (-S)
+  bool emit_bc = false;     // ... <base>.bc (-emit-bc)
+  bool emit_header = false; // ... <base>.h, prototipi extern "C" (-emit-header)
+  bool batch = false;       // Versioni <f>_batch delle funzioni esportate (--batch)
+  LTOKind lto = LTOKind::None; // Con -flto l'oggetto è il bitcode <base>.bc
+  bool time_report = false; // Tabella dei tempi delle fasi su stderr
+  bool time_trace = false;  // Traccia in formato Chrome (<base>.json)
+  unsigned trace_granularity = 500; // Durata minima (µs) degli span registrati
+  std::string cpu = "generic";      // CPU target (-mcpu)
+  std::string features = "";        // Feature target (-mattr, e quelle dell'host con -mcpu=native)
+  std::vector<std::string> versions; // CPU per cui clonare le funzioni esportate (-mversions)
+  FastMathFlags fmf;                // Flag fast-math (-ffast-math, -fno-signed-zeros, ...)
+  FPContract fp_contract = FPContract::Off; // -ffp-contract
+  bool whole_program = false;        // Il sorgente è l'intero programma (--whole-program)
+  std::vector<std::string> exports; // Funzioni visibili dall'esterno (--export)
+  std::string profile_generate = ""; // Profilo scritto all'uscita dai programmi strumentati
+  std::string profile_use = "";     // Profilo (.profdata) usato per l'ottimizzazione
+  std::string profile_id = "";      // Hash del contenuto del profilo, per la cache
+  std::string cache_dir = "";       // Cache degli oggetti delle singole funzioni
+  std::string compiler_id = "";     // Identifica l'eseguibile di kfe nelle chiavi della cache
+  OptimizationLevel OptLevel = OptimizationLevel::O0; // Di default nessuna ottimizzazione
+  CodeGenOpt::Level CGLevel = CodeGenOpt::Default;
+};
+
+// Serializza i messaggi su stdout dei job eseguiti in parallelo
+static std::mutex OutMutex;
+
+// Applica al modulo la pipeline di ottimizzazione del new pass manager
+// corrispondente al livello richiesto (-O0 ... -O3). Il target machine viene
+// passato al PassBuilder così che i cost model (vettorizzatori, unroll, ...)
+// usino le informazioni della macchina target. Con -flto viene usata la
+// pipeline di pre-link, che lascia al linker inlining e ottimizzazioni tra
+// moduli (compreso il codice C++ che chiama le funzioni Kaleidoscope).
+// Con PGO la pipeline strumenta il codice (contatori sugli archi del CFG e
+// all'ingresso delle funzioni) oppure legge il profilo e ne ricava i pesi
+// dei salti e i conteggi di ingresso (metadati !prof)
+static void optimizeModule(Module &M, TargetMachine *TM, OptimizationLevel Level,
+                           LTOKind LTO = LTOKind::None, Optional<PGOOptions> PGO = None) {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  PipelineTuningOptions PTO;
+  PTO.LoopVectorization = Level.getSpeedupLevel() > 1;
+  PTO.SLPVectorization = Level.getSpeedupLevel() > 1;
+  // Con -ftime-trace ogni pass diventa uno span della traccia, con il nome
+  // della funzione (o del loop) su cui viene eseguito come dettaglio
+  PassInstrumentationCallbacks PIC;
+  if (timeTraceProfilerEnabled()) {
+    PIC.registerBeforeNonSkippedPassCallback([](StringRef P, Any IR) {
+      std::string Detail;
+      if (any_isa<const Function *>(IR))
+        Detail = any_cast<const Function *>(IR)->getName().str();
+      else if (any_isa<const Loop *>(IR))
+        Detail = any_cast<const Loop *>(IR)->getName().str();
+      timeTraceProfilerBegin(P, Detail);
+    });
+    PIC.registerAfterPassCallback(
+        [](StringRef, Any, const PreservedAnalyses &) { timeTraceProfilerEnd(); });
+    PIC.registerAfterPassInvalidatedCallback(
+        [](StringRef, const PreservedAnalyses &) { timeTraceProfilerEnd(); });
+  }
+  PassBuilder PB(TM, PTO, PGO, &PIC);
+
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if (Level == OptimizationLevel::O0)
+    MPM = PB.buildO0DefaultPipeline(Level, LTO != LTOKind::None);
+  else if (LTO == LTOKind::Thin)
+    MPM = PB.buildThinLTOPreLinkDefaultPipeline(Level);
+  else if (LTO == LTOKind::Full)
+    MPM = PB.buildLTOPreLinkDefaultPipeline(Level);
+  else
+    MPM = PB.buildPerModuleDefaultPipeline(Level);
+  MPM.run(M, MAM);
+}
+
+// Feature x86 nell'ordine dei bit di __cpu_model.__cpu_features[0], la
+// struttura riempita da __cpu_indicator_init (libgcc e compiler-rt)
+static const char *const CpuModelFeatures[] = {
+#define X86_FEATURE(ENUM, STR)
+#define X86_FEATURE_COMPAT(ENUM, STR, PRIORITY) STR,
+#include "llvm/Support/X86TargetParser.def"
+};
+
+// Bit di CPUID delle feature che __cpu_model non riporta (o riporta solo
+// in __cpu_features2, la cui dimensione dipende dalla versione di libgcc)
+struct CpuidBit {
+  const char *Feature;
+  unsigned Leaf, Sub;
+  unsigned Reg; // 0 = eax, 1 = ebx, 2 = ecx, 3 = edx
+  unsigned Bit;
+};
+
+static const CpuidBit CpuidBits[] = {
+  {"cx8", 1, 0, 3, 8},          {"fxsr", 1, 0, 3, 24},
+  {"cx16", 1, 0, 2, 13},        {"crc32", 1, 0, 2, 20},
+  {"movbe", 1, 0, 2, 22},       {"xsave", 1, 0, 2, 26},
+  {"f16c", 1, 0, 2, 29},        {"rdrnd", 1, 0, 2, 30},
+  {"fsgsbase", 7, 0, 1, 0},     {"sgx", 7, 0, 1, 2},
+  {"invpcid", 7, 0, 1, 10},     {"rtm", 7, 0, 1, 11},
+  {"rdseed", 7, 0, 1, 18},      {"adx", 7, 0, 1, 19},
+  {"clflushopt", 7, 0, 1, 23},  {"clwb", 7, 0, 1, 24},
+  {"sha", 7, 0, 1, 29},         {"prefetchwt1", 7, 0, 2, 0},
+  {"pku", 7, 0, 2, 3},          {"waitpkg", 7, 0, 2, 5},
+  {"shstk", 7, 0, 2, 7},        {"gfni", 7, 0, 2, 8},
+  {"vaes", 7, 0, 2, 9},         {"vpclmulqdq", 7, 0, 2, 10},
+  {"avx512vnni", 7, 0, 2, 11},  {"avx512bitalg", 7, 0, 2, 12},
+  {"rdpid", 7, 0, 2, 22},       {"kl", 7, 0, 2, 23},
+  {"cldemote", 7, 0, 2, 25},    {"movdiri", 7, 0, 2, 27},
+  {"movdir64b", 7, 0, 2, 28},   {"enqcmd", 7, 0, 2, 29},
+  {"uintr", 7, 0, 3, 5},        {"avx512vp2intersect", 7, 0, 3, 8},
+  {"serialize", 7, 0, 3, 14},   {"tsxldtrk", 7, 0, 3, 16},
+  {"pconfig", 7, 0, 3, 18},     {"avx512fp16", 7, 0, 3, 23},
+  {"avxvnni", 7, 1, 0, 4},      {"avx512bf16", 7, 1, 0, 5},
+  {"hreset", 7, 1, 0, 22},      {"xsaveopt", 0xD, 1, 0, 0},
+  {"xsavec", 0xD, 1, 0, 1},     {"xsaves", 0xD, 1, 0, 3},
+  {"ptwrite", 0x14, 0, 1, 4},    {"widekl", 0x19, 0, 1, 2},
+  {"sahf", 0x80000001, 0, 2, 0}, {"lzcnt", 0x80000001, 0, 2, 5},
+  {"prfchw", 0x80000001, 0, 2, 8}, {"lwp", 0x80000001, 0, 2, 15},
+  {"tbm", 0x80000001, 0, 2, 21}, {"mwaitx", 0x80000001, 0, 2, 29},
+  {"3dnowa", 0x80000001, 0, 3, 30}, {"3dnow", 0x80000001, 0, 3, 31},
+  {"clzero", 0x80000008, 0, 1, 0}, {"wbnoinvd", 0x80000008, 0, 1, 9},
+};
+
+// Controlli eseguiti dal resolver per una versione: i bit di
+// __cpu_model.__cpu_features[0] (che per AVX e AVX-512 comprendono il
+// supporto del sistema operativo) e i bit di CPUID delle altre feature
+struct CpuTest {
+  uint32_t Mask = 0;
+  std::vector<const CpuidBit*> Cpuid;
+  unsigned Features = 0; // Numero di feature richieste, per l'ordinamento
+};
+
+// Controlli necessari per le feature richieste da una CPU x86; false (con la
+// feature in Missing) se una di esse non è verificabile al caricamento, come
+// le AMX, che richiedono anche il permesso del sistema operativo
+static bool cpuFeatureTest(StringRef CPU, CpuTest &T, std::string &Missing) {
+  SmallVector<StringRef, 32> Features;
+  X86::getFeaturesForCPU(CPU, Features);
+  StringMap<bool> All; // Comprese quelle implicate (es. sse4.2 implica sse4.1)
+  for (StringRef F : Features) {
+    All[F] = true;
+    X86::updateImpliedFeatures(F, true, All);
+  }
+  T = CpuTest();
+  for (auto &F : All) {
+    if (!F.second || F.first() == "x87" || F.first() == "64bit")
+      continue; // Sempre presenti su x86-64
+    T.Features++;
+    unsigned i = 0;
+    while (i < 32 && F.first() != CpuModelFeatures[i])
+      ++i;
+    if (i < 32) {
+      T.Mask |= 1u << i;
+      continue;
+    }
+    auto B = llvm::find_if(CpuidBits, [&](const CpuidBit &B) { return F.first() == B.Feature; });
+    if (B == std::end(CpuidBits)) {
+      Missing = F.first().str();
+      return false;
+    }
+    T.Cpuid.push_back(B);
+  }
+  return true;
+}
+
+// Lettura di CPUID nel resolver (istruzione cpuid in assembly inline). Ogni
+// foglia viene letta una volta; quelle oltre la massima supportata dalla CPU
+// (foglia 0 e 0x80000000) valgono zero
+class CpuidReader {
+private:
+  IRBuilder<> &B;
+  std::map<std::pair<unsigned, unsigned>, Value*> Leaves;
+  Value *MaxBasic = nullptr, *MaxExt = nullptr;
+
+  Value *cpuid(unsigned Leaf, unsigned Sub) {
+    Type *I32 = B.getInt32Ty();
+    StructType *Regs = StructType::get(B.getContext(), {I32, I32, I32, I32});
+    InlineAsm *Asm = InlineAsm::get(FunctionType::get(Regs, {I32, I32}, false), "cpuid",
+                                    "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}",
+                                    false);
+    return B.CreateCall(Asm, {B.getInt32(Leaf), B.getInt32(Sub)}, "cpuid");
+  }
+
+public:
+  CpuidReader(IRBuilder<> &B): B(B) {};
+
+  Value *reg(unsigned Leaf, unsigned Sub, unsigned Reg) {
+    auto &V = Leaves[{Leaf, Sub}];
+    if (!V) {
+      Value *Max;
+      if (Leaf >= 0x80000000) {
+        if (!MaxExt)
+          MaxExt = B.CreateExtractValue(cpuid(0x80000000, 0), 0, "maxext");
+        Max = MaxExt;
+      } else {
+        if (!MaxBasic)
+          MaxBasic = B.CreateExtractValue(cpuid(0, 0), 0, "maxbasic");
+        Max = MaxBasic;
+      }
+      Value *Valid = B.CreateICmpUGE(Max, B.getInt32(Leaf));
+      if (Sub) // Le sottofoglie della 7 sono indicate da eax della 7.0
+        Valid = B.CreateAnd(Valid, Leaf == 7 ? B.CreateICmpUGE(reg(7, 0, 0), B.getInt32(Sub))
+                                             : B.getTrue());
+      Value *Regs = cpuid(Leaf, Sub);
+      V = B.CreateSelect(Valid, Regs, Constant::getNullValue(Regs->getType()));
+    }
+    return B.CreateExtractValue(V, Reg);
+  }
+
+  Value *test(const CpuidBit &Bit) {
+    Value *R = reg(Bit.Leaf, Bit.Sub, Bit.Reg);
+    return B.CreateICmpNE(B.CreateAnd(R, B.getInt32(1u << Bit.Bit)), B.getInt32(0), Bit.Feature);
+  }
+};
+
+// -mversions: ogni funzione esportata viene clonata per ciascuna CPU e il
+// suo simbolo diventa un ifunc, il cui resolver sceglie al caricamento la
+// versione più specializzata supportata dalla CPU (come il multiversioning
+// di GCC e Clang). La versione di default resta quella compilata per -mcpu.
+// Nei cloni le chiamate tra funzioni esportate restano nella stessa versione,
+// così possono ancora essere inlined. Vengono clonate anche le funzioni
+// interne di cui le esportate passano l'indirizzo (i corpi dei parfor,
+// eseguiti dal runtime), che altrimenti resterebbero generiche
+static void multiversion(Module &M, ArrayRef<std::string> Versions) {
+  std::vector<Function*> Exported;
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.hasExternalLinkage())
+      Exported.push_back(&F);
+  if (Exported.empty())
+    return;
+
+  std::vector<Function*> Cloned = Exported;
+  SmallPtrSet<Function*, 8> Seen;
+  for (unsigned i = 0; i < Cloned.size(); ++i)
+    for (Instruction &I : instructions(*Cloned[i]))
+      for (Use &U : I.operands()) {
+        auto *G = dyn_cast<Function>(U->stripPointerCasts());
+        auto *CB = dyn_cast<CallBase>(&I);
+        if (G && G->hasLocalLinkage() && !G->isDeclaration() && !(CB && CB->isCallee(&U)) &&
+            Seen.insert(G).second)
+          Cloned.push_back(G);
+      }
+
+  // Prima le versioni che richiedono più feature (verificabili: controllato
+  // sulla riga di comando)
+  std::vector<std::pair<std::string, CpuTest>> Vs;
+  for (const std::string &CPU : Versions) {
+    CpuTest T;
+    std::string Missing;
+    cpuFeatureTest(CPU, T, Missing);
+    Vs.emplace_back(CPU, T);
+  }
+  std::stable_sort(Vs.begin(), Vs.end(), [](const auto &A, const auto &B) {
+    return A.second.Features > B.second.Features;
+  });
+
+  std::vector<std::vector<Function*>> Clones(Exported.size());
+  for (auto &V : Vs) {
+    ValueToValueMapTy VMap;
+    for (Function *F : Cloned)
+      VMap[F] = Function::Create(F->getFunctionType(), GlobalValue::InternalLinkage,
+                                 F->getName() + "." + V.first, M);
+    for (unsigned i = 0; i < Cloned.size(); ++i) {
+      Function *F = Cloned[i], *NF = cast<Function>(VMap[F]);
+      auto NA = NF->arg_begin();
+      for (Argument &A : F->args()) {
+        NA->setName(A.getName());
+        VMap[&A] = &*NA++;
+      }
+      SmallVector<ReturnInst*, 4> Returns;
+      CloneFunctionInto(NF, F, VMap, CloneFunctionChangeType::LocalChangesOnly, Returns);
+      NF->addFnAttr("target-cpu", V.first);
+      NF->removeFnAttr("target-features");
+      if (i < Exported.size())
+        Clones[i].push_back(NF);
+    }
+  }
+
+  LLVMContext &C = M.getContext();
+  Type *I32 = Type::getInt32Ty(C);
+  StructType *ModelTy = StructType::get(C, {I32, I32, I32, ArrayType::get(I32, 1)});
+  Constant *Model = M.getOrInsertGlobal("__cpu_model", ModelTy);
+  FunctionCallee Init = M.getOrInsertFunction("__cpu_indicator_init", Type::getVoidTy(C));
+  for (unsigned i = 0; i < Exported.size(); ++i) {
+    Function *F = Exported[i];
+    std::string Name = F->getName().str();
+    F->setName(Name + ".default");
+    F->setLinkage(GlobalValue::InternalLinkage);
+
+    // Il resolver parte dalla versione di default e la sostituisce con
+    // ciascuna versione supportata, dalla meno alla più preferita
+    Function *R = Function::Create(FunctionType::get(F->getType(), false),
+                                   GlobalValue::InternalLinkage, Name + ".resolver", M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", R));
+    B.CreateCall(Init);
+    Value *Features = B.CreateLoad(I32, B.CreateInBoundsGEP(ModelTy, Model,
+        {B.getInt32(0), B.getInt32(3), B.getInt32(0)}), "features");
+    CpuidReader Cpuid(B);
+    Value *Chosen = F;
+    for (unsigned j = Vs.size(); j-- > 0;) {
+      const CpuTest &T = Vs[j].second;
+      Value *Mask = B.getInt32(T.Mask);
+      Value *Has = B.CreateICmpEQ(B.CreateAnd(Features, Mask), Mask);
+      for (const CpuidBit *Bit : T.Cpuid)
+        Has = B.CreateAnd(Has, Cpuid.test(*Bit));
+      Has->setName("has." + Vs[j].first);
+      Chosen = B.CreateSelect(Has, Clones[i][j], Chosen);
+    }
+    B.CreateRet(Chosen);
+    GlobalIFunc::create(F->getFunctionType(), 0, GlobalValue::ExternalLinkage, Name, R, &M);
+  }
+}
+
+// --whole-program: il modulo contiene l'intero programma. Le definizioni non
+// esportate diventano interne e quelle non raggiungibili dalle esportate
+// vengono eliminate, insieme alle dichiarazioni rimaste inutilizzate
+static bool internalize(Module &M, ArrayRef<std::string> Exports, StringRef Source) {
+  SmallVector<Function*, 16> Work;
+  for (const std::string &E : Exports) {
+    Function *F = M.getFunction(E);
+    if (!F || F->isDeclaration()) {
+      errs() << "--export: '" << E << "' is not defined in " << Source << "\n";
+      return true;
+    }
+    Work.push_back(F);
+  }
+  SmallPtrSet<Function*, 32> Live(Work.begin(), Work.end());
+  while (!Work.empty()) {
+    Function *F = Work.pop_back_val();
+    for (Instruction &I : instructions(F))
+      for (Value *Op : I.operands())
+        if (auto *G = dyn_cast<Function>(Op->stripPointerCasts()))
+          if (Live.insert(G).second)
+            Work.push_back(G);
+  }
+  std::vector<Function*> Dead;
+  for (Function &F : M)
+    if (!Live.count(&F))
+      Dead.push_back(&F);
+    else if (!F.isDeclaration())
+      F.setLinkage(is_contained(Exports, F.getName()) ? GlobalValue::ExternalLinkage
+                                                      : GlobalValue::InternalLinkage);
+  for (Function *F : Dead)
+    F->dropAllReferences();
+  for (Function *F : Dead)
+    F->eraseFromParent();
+  return false;
+}
+
+// --batch: per ogni funzione esportata f(x, y) genera
+//   void f_batch(const double *x, const double *y, double *__restrict out, int64_t n)
+// che calcola out[i] = f(x[i], y[i]) per i < n. Il corpo di f viene inlined
+// nel loop, marcato per la vettorizzazione: una sola chiamata dal codice C
+// al posto di una per elemento. Le funzioni con parametri puntatore non
+// hanno la versione batch
+static void batchWrappers(Module &M) {
+  std::vector<Function*> Exported;
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.hasExternalLinkage() &&
+        !F.getName().startswith("__espr_anonima") &&
+        none_of(F.args(), [](Argument &A) { return A.getType()->isPointerTy(); }))
+      Exported.push_back(&F);
+  LLVMContext &C = M.getContext();
+  Type *I64 = Type::getInt64Ty(C);
+  for (Function *F : Exported) {
+    std::string Name = F->getName().str() + "_batch";
+    if (M.getFunction(Name)) {
+      errs() << "--batch: " << Name << " is already defined, wrapper not generated\n";
+      continue;
+    }
+    std::vector<Type*> Params;
+    for (Argument &A : F->args())
+      Params.push_back(PointerType::getUnqual(A.getType()));
+    Params.push_back(PointerType::getUnqual(F->getReturnType()));
+    Params.push_back(I64);
+    Function *B = Function::Create(FunctionType::get(Type::getVoidTy(C), Params, false),
+                                   GlobalValue::ExternalLinkage, Name, M);
+    // Gli ingressi sono solo letti; out non si sovrappone agli ingressi
+    unsigned NArgs = F->arg_size();
+    for (unsigned i = 0; i < NArgs; ++i) {
+      B->getArg(i)->setName(F->getArg(i)->getName());
+      B->getArg(i)->addAttr(Attribute::ReadOnly);
+      B->getArg(i)->addAttr(Attribute::NoCapture);
+    }
+    Argument *Out = B->getArg(NArgs), *N = B->getArg(NArgs + 1);
+    Out->setName("out");
+    Out->addAttr(Attribute::NoAlias);
+    Out->addAttr(Attribute::NoCapture);
+    N->setName("n");
+    B->addFnAttr(Attribute::NoUnwind);
+    // Il corpo di f viene copiato in B: se f può non terminare (un loop
+    // infinito senza effetti) mustprogress permetterebbe di eliminarlo
+    if (F->hasFnAttribute(Attribute::WillReturn))
+      B->addFnAttr(Attribute::MustProgress);
+
+    BasicBlock *Entry = BasicBlock::Create(C, "entry", B);
+    BasicBlock *Loop = BasicBlock::Create(C, "loop", B);
+    BasicBlock *Exit = BasicBlock::Create(C, "exit", B);
+    IRBuilder<> Builder(Entry);
+    Builder.CreateCondBr(Builder.CreateICmpSGT(N, Builder.getInt64(0)), Loop, Exit);
+    Builder.SetInsertPoint(Loop);
+    PHINode *I = Builder.CreatePHI(I64, 2, "i");
+    I->addIncoming(Builder.getInt64(0), Entry);
+    std::vector<Value*> Args;
+    for (unsigned i = 0; i < NArgs; ++i) {
+      Type *T = F->getArg(i)->getType();
+      Args.push_back(Builder.CreateLoad(T, Builder.CreateInBoundsGEP(T, B->getArg(i), I)));
+    }
+    CallInst *Call = Builder.CreateCall(F, Args);
+    Builder.CreateStore(Call, Builder.CreateInBoundsGEP(F->getReturnType(), Out, I));
+    Value *Next = Builder.CreateAdd(I, Builder.getInt64(1), "next", true, true);
+    I->addIncoming(Next, Loop);
+    BranchInst *BackEdge = Builder.CreateCondBr(Builder.CreateICmpSLT(Next, N), Loop, Exit);
+    Builder.SetInsertPoint(Exit);
+    Builder.CreateRetVoid();
+
+    // La vettorizzazione viene forzata solo se f non contiene loop, ricorsione
+    // o chiamate extern (willreturn, dall'analisi degli effetti): negli altri
+    // casi decide il cost model, senza avvisi per i loop non vettorizzabili
+    SmallVector<Metadata*, 3> MDs = {nullptr, MDNode::get(C, MDString::get(C, "llvm.loop.mustprogress"))};
+    if (F->hasFnAttribute(Attribute::WillReturn))
+      MDs.push_back(MDNode::get(C, {MDString::get(C, "llvm.loop.vectorize.enable"),
+                                    ConstantAsMetadata::get(Builder.getTrue())}));
+    MDNode *LoopID = MDNode::getDistinct(C, MDs);
+    LoopID->replaceOperandWith(0, LoopID);
+    BackEdge->setMetadata(LLVMContext::MD_loop, LoopID);
+
+    // Se f non può essere inlined (es. è ricorsiva) la chiamata resta
+    InlineFunctionInfo IFI;
+    InlineFunction(*Call, IFI);
+  }
+}
+
+// Le funzioni non visibili dall'esterno (linkage locale) e chiamate solo
+// direttamente usano la convenzione fastcc, anche senza ottimizzazioni (con
+// -O1 e oltre lo farebbe anche GlobalOpt). Chiamante e chiamata di una
+// musttail devono avere la stessa convenzione: cambiano entrambe o nessuna
+static void fastInternalCalls(Module &M) {
+  SmallPtrSet<Function*, 16> Fast;
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.hasLocalLinkage() && F.getCallingConv() == CallingConv::C &&
+        all_of(F.uses(), [](const Use &U) {
+          auto *CB = dyn_cast<CallBase>(U.getUser());
+          return CB && CB->isCallee(&U);
+        }))
+      Fast.insert(&F);
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (Function &F : M)
+      for (Instruction &I : instructions(F)) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (CI && CI->isMustTailCall() &&
+            Fast.count(&F) != Fast.count(CI->getCalledFunction())) {
+          Fast.erase(&F);
+          Fast.erase(CI->getCalledFunction());
+          Changed = true;
+        }
+      }
+  }
+  for (Function *F : Fast) {
+    F->setCallingConv(CallingConv::Fast);
+    for (User *U : F->users())
+      cast<CallBase>(U)->setCallingConv(CallingConv::Fast);
+  }
+}
+
+// -mcpu e -mattr diventano anche attributi delle funzioni, così restano
+// nell'IR e nel bitcode prodotti; poi, con -mversions, le funzioni
+// esportate vengono clonate per le altre CPU. Infine le funzioni interne
+// passano a fastcc
+static void targetModule(Module &M, const Options &O) {
+  for (Function &F : M)
+    if (!F.isDeclaration()) {
+      F.addFnAttr("target-cpu", O.cpu);
+      if (!O.features.empty())
+        F.addFnAttr("target-features", O.features);
+    }
+  if (!O.versions.empty())
+    multiversion(M, O.versions);
+  fastInternalCalls(M);
+}
+
+// Opzioni PGO della pipeline (-fprofile-generate, -fprofile-use)
+static Optional<PGOOptions> pgoOptions(const Options &O) {
+  if (!O.profile_generate.empty())
+    return PGOOptions(O.profile_generate, "", "", PGOOptions::IRInstr);
+  if (!O.profile_use.empty())
+    return PGOOptions(O.profile_use, "", "", PGOOptions::IRUse);
+  return None;
+}
+
+// Chiave della cache di una definizione: oltre all'hash del suo AST (che
+// comprende i prototipi delle funzioni chiamate) il codice oggetto dipende
+// dal compilatore, dal target e dalle opzioni
+static std::string cacheKey(const Options &O, StringRef Triple, StringRef Digest) {
+  MD5 H;
+  H.update(O.compiler_id);
+  H.update(LLVM_VERSION_STRING);
+  for (StringRef Part : {Triple, StringRef(O.cpu), StringRef(O.features)}) {
+    H.update(ArrayRef<uint8_t>{0});
+    H.update(Part);
+  }
+  for (const std::string &V : O.versions) {
+    H.update(ArrayRef<uint8_t>{1});
+    H.update(V);
+  }
+  H.update(ArrayRef<uint8_t>{(uint8_t)O.OptLevel.getSpeedupLevel(), (uint8_t)O.OptLevel.getSizeLevel(),
+                             (uint8_t)O.CGLevel, O.simplify});
+  H.update(ArrayRef<uint8_t>{O.fmf.allowReassoc(), O.fmf.noNaNs(), O.fmf.noInfs(),
+                             O.fmf.noSignedZeros(), O.fmf.allowReciprocal(), O.fmf.allowContract(),
+                             O.fmf.approxFunc(), (uint8_t)O.fp_contract, O.batch});
+  H.update(O.profile_generate);
+  H.update(ArrayRef<uint8_t>{0});
+  H.update(O.profile_id);
+  H.update(Digest);
+  MD5::MD5Result R;
+  H.final(R);
+  return std::string(R.digest());
+}
+
+// Tipo C di un parametro o del valore restituito: i puntatori noalias
+// diventano puntatori __restrict, quelli readonly puntatori a const
+static std::string cType(Type *T, bool NoAlias, bool ReadOnly = false) {
+  if (T->isPointerTy())
+    return (ReadOnly ? "const " : "") + cType(T->getPointerElementType(), false) +
+           (NoAlias ? "*__restrict " : "*");
+  if (T->isVoidTy())
+    return "void ";
+  return T->isIntegerTy() ? "int64_t " : "double ";
+}
+
+// Aggiunge a Out i prototipi C delle funzioni definite ed esportate dal
+// modulo, prima di targetModule (che con -mversions le rinomina). Le
+// espressioni top-level non vengono dichiarate
+static void collectPrototypes(const Module &M, std::string &Out) {
+  raw_string_ostream OS(Out);
+  for (const Function &F : M) {
+    if (F.isDeclaration() || !F.hasExternalLinkage() || F.getName().startswith("__espr_anonima"))
+      continue;
+    OS << cType(F.getReturnType(), false) << F.getName() << "(";
+    for (const Argument &A : F.args())
+      OS << (A.getArgNo() ? ", " : "")
+         << cType(A.getType(), A.hasNoAliasAttr(), A.onlyReadsMemory()) << A.getName();
+    OS << (F.arg_empty() ? "void);\n" : ");\n");
+  }
+}
+
+// Emette il codice macchina del modulo (oggetto o assembly) sullo stream
+static bool emitCode(Module &M, TargetMachine *TM, raw_pwrite_stream &dest,
+                     CodeGenFileType FileType) {
+  legacy::PassManager pass;
+  if (TM->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
+    errs() << "TheTargetMachine can't emit a file of this type";
+    return true;
+  }
+  pass.run(M);
+  return false;
+}
+
+// Apre Filename in un raw_fd_ostream (bufferizzato) e vi scrive con Write
+static bool writeFile(const std::string &Filename, sys::fs::OpenFlags Flags,
+                      function_ref<bool(raw_fd_ostream&)> Write) {
+  std::error_code EC;
+  raw_fd_ostream dest(Filename, EC, Flags);
+  if (EC) {
+    errs() << "Could not open file: " << EC.message();
+    return true;
+  }
+  if (Write(dest))
+    return true;
+  dest.flush();
+  std::lock_guard<std::mutex> Lock(OutMutex);
+  outs() << "Wrote " << Filename << "\n";
+  return false;
+}
+
+// Header con i prototipi extern "C" delle funzioni di Source, da includere
+// nel codice C o C++ che le chiama
+static bool writeHeader(const std::string &Base, const std::string &Source,
+                        StringRef Prototypes) {
+  std::string Guard = "KFE_";
+  for (char c : sys::path::filename(Base))
+    Guard += isAlnum(c) ? toUpper(c) : '_';
+  Guard += "_H";
+  return writeFile(Base + ".h", sys::fs::OF_Text, [&](raw_fd_ostream &dest) {
+    dest << "// Generato da kfe a partire da " << Source << "\n"
+         << "#ifndef " << Guard << "\n#define " << Guard << "\n\n"
+         << "#include <stdint.h>\n\n"
+         << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n"
+         << Prototypes
+         << "\n#ifdef __cplusplus\n}\n#endif\n\n#endif // " << Guard << "\n";
+    return false;
+  });
+}
+
+// Esegue la sola analisi lessicale del file e ne stampa il throughput
+static int scanFile(const Options &O, const std::string &Source) {
+  driver drv;
+  drv.trace_scanning = O.trace_scanning;
+  drv.stdio_input = O.stdio_input;
+  uint64_t Size = 0;
+  sys::fs::file_size(Source, Size);
+  auto Start = std::chrono::steady_clock::now();
+  size_t Tokens;
+  if (drv.scan(Source, Tokens))
+    return 1;
+  std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+  double MB = Size / (1024.0 * 1024.0);
+  std::lock_guard<std::mutex> Lock(OutMutex);
+  outs() << Source << ": " << Tokens << " token, " << format("%.2f", MB) << " MB in "
+         << format("%.3f", Elapsed.count()) << " s ("
+         << format("%.1f", MB / Elapsed.count()) << " MB/s, "
+         << (O.stdio_input ? "stdio" : "mmap") << ")\n";
+  return 0;
+}
+
+// Compila un file sorgente. Ogni job ha il proprio driver (e quindi il proprio
+// LLVMContext, Module, IRBuilder e scanner) e il proprio TargetMachine, per cui
+// più file possono essere compilati in parallelo senza stato condiviso.
+// Gli artefatti richiesti vengono scritti in <Base>.{o,ll,s,bc}, tutti a
+// partire dallo stesso modulo ottimizzato, e i prototipi in <Base>.h
+static int compileFile(const Target *T, const std::string &TargetTriple, const Options &O,
+                       const std::string &Source, const std::string &Base) {
+  if (O.scan_only)
+    return scanFile(O, Source);
+  driver drv;
+  drv.trace_parsing = O.trace_parsing;
+  drv.trace_scanning = O.trace_scanning;
+  drv.stdio_input = O.stdio_input;
+  drv.ast_print = O.ast_print;
+  drv.mem_stats = O.mem_stats;
+  drv.print_ir = O.print_ir;
+  drv.simplify = O.simplify;
+  drv.fmf = O.fmf;
+  drv.fp_contract = O.fp_contract;
+  drv.instrumented = !O.profile_generate.empty();
+  drv.streaming = O.stream;
+  drv.timer.enabled = O.time_report;
+  auto Report = make_scope_exit([&]() {
+    if (!O.time_report)
+      return;
+    std::lock_guard<std::mutex> Lock(OutMutex);
+    drv.timer.report(errs(), Source);
+  });
+  /************************** Set-up macchina target ********************/
+  TargetOptions opt;
+  // Con -ffp-contract=fast il backend fonde in FMA anche le operazioni
+  // separate; altrimenti solo llvm.fmuladd e le operazioni con il flag contract
+  if (O.fp_contract == FPContract::Fast)
+    opt.AllowFPOpFusion = FPOpFusion::Fast;
+  // Il resolver degli ifunc (-mversions) e i parfor usano indirizzi di
+  // funzioni: il codice è PIC, così l'oggetto può essere linkato anche in un PIE
+  std::unique_ptr<TargetMachine> TheTargetMachine(
+      T->createTargetMachine(TargetTriple, O.cpu, O.features, opt, Reloc::PIC_, None, O.CGLevel));
+  /************************* Configurazione del modulo *****************/
+  drv.module->setDataLayout(TheTargetMachine->createDataLayout());
+  drv.module->setTargetTriple(TargetTriple);
+  /***********************************************************************/
+  /************* Fine set-up per creazione codice oggetto ****************/
+  /***********************************************************************/
+  // In modalità streaming ogni definizione arriva in un modulo a sé, che
+  // viene ottimizzato e compilato subito e poi distrutto; i codici oggetto
+  // diventano i membri di un archivio. Senza -o l'IR viene solo scartato
+  std::vector<NewArchiveMember> Members;
+  std::deque<std::string> MemberNames;
+  auto addMember = [&](std::unique_ptr<MemoryBuffer> Buf) {
+    NewArchiveMember Member;
+    MemberNames.push_back("f" + std::to_string(Members.size()) + ".o");
+    Member.MemberName = MemberNames.back();
+    Member.Buf = std::move(Buf);
+    Members.push_back(std::move(Member));
+  };
+  bool SinkFailed = false;
+  std::string Prototypes; // Contenuto dell'header (-emit-header)
+  // Cache per funzione (--cache-dir): l'oggetto di ogni definizione viene
+  // memorizzato con la chiave calcolata da cacheKey. Sia gli oggetti trovati
+  // in cache che quelli appena scritti arrivano ad addMember. localCache
+  // scrive ogni file in un temporaneo e lo rinomina, così più kfe possono
+  // usare la stessa cache in parallelo
+  FileCache Cache;
+  AddStreamFn Pending; // Destinazione dell'oggetto della definizione mancante
+  unsigned Hits = 0, Misses = 0;
+  if (O.stream && O.emit_obj && O.cache_dir != "") {
+    auto C = localCache("kfe", "kfe-tmp", O.cache_dir,
+                        [&](unsigned, std::unique_ptr<MemoryBuffer> MB) { addMember(std::move(MB)); });
+    if (!C) {
+      logAllUnhandledErrors(C.takeError(), errs(), "Cache: ");
+      return 1;
+    }
+    Cache = std::move(*C);
+    drv.cacheLookup = [&](StringRef Digest) {
+      Pending = nullptr;
+      Expected<AddStreamFn> AddStream = Cache(0, cacheKey(O, TargetTriple, Digest));
+      if (!AddStream) {
+        logAllUnhandledErrors(AddStream.takeError(), errs(), "Cache: ");
+        return false;
+      }
+      if (!*AddStream) {
+        Hits++;
+        return true;
+      }
+      Misses++;
+      Pending = std::move(*AddStream);
+      return false;
+    };
+  }
+  if (O.stream)
+    drv.moduleSink = [&](std::unique_ptr<Module> M) {
+      if (O.batch)
+        batchWrappers(*M);
+      if (O.emit_header)
+        collectPrototypes(*M, Prototypes);
+      if (!O.emit_obj)
+        return;
+      {
+        PhaseScope Scope(drv.timer, Phase::Optimize, "Optimize");
+        targetModule(*M, O);
+        optimizeModule(*M, TheTargetMachine.get(), O.OptLevel, LTOKind::None, pgoOptions(O));
+      }
+      PhaseScope Scope(drv.timer, Phase::Emit, "Emit");
+      SmallVector<char, 0> Obj;
+      raw_svector_ostream dest(Obj);
+      if (emitCode(*M, TheTargetMachine.get(), dest, CGFT_ObjectFile)) {
+        SinkFailed = true;
+        return;
+      }
+      if (!Pending) {
+        addMember(std::make_unique<SmallVectorMemoryBuffer>(std::move(Obj), "", false));
+        return;
+      }
+      // L'oggetto va in cache; alla chiusura dello stream diventa un membro
+      Expected<std::unique_ptr<CachedFileStream>> Stream = Pending(0);
+      Pending = nullptr;
+      if (!Stream) {
+        logAllUnhandledErrors(Stream.takeError(), errs(), "Cache: ");
+        SinkFailed = true;
+        return;
+      }
+      *(*Stream)->OS << Obj;
+      Stream->reset();
+    };
+  auto Start = std::chrono::steady_clock::now();
+  if (drv.parse(Source))  // Parsing e creazione dell'AST
+    return 1;
+  if (O.parse_only) {
+    std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+    std::lock_guard<std::mutex> Lock(OutMutex);
+    outs() << Source << ": " << drv.arena.nodes() << " nodi in "
+           << format("%.3f", Elapsed.count()) << " s ("
+           << format("%.0f", drv.arena.nodes() / Elapsed.count()) << " nodi/s)\n";
+    return 0;
+  }
+  drv.codegen();          // Visita AST e generazione dell'IR
+  if (Base == "")
+    return 0;
+  if (O.stream) {
+    drv.flushModule();    // Eventuali dichiarazioni rimaste nel modulo corrente
+    if (SinkFailed)
+      return 1;
+    PhaseScope Scope(drv.timer, Phase::Emit, "Emit");
+    if (O.emit_header && writeHeader(Base, Source, Prototypes))
+      return 1;
+    if (!O.emit_obj)
+      return 0;
+    std::string Filename = Base + ".a";
+    if (Error Err = writeArchive(Filename, Members, true, object::Archive::K_GNU,
+                                 true, false)) {
+      logAllUnhandledErrors(std::move(Err), errs(), "Could not write archive: ");
+      return 1;
+    }
+    std::lock_guard<std::mutex> Lock(OutMutex);
+    outs() << "Wrote " << Filename << "\n";
+    if (drv.cacheLookup)
+      outs() << Source << ": cache " << Hits << " hit, " << Misses << " miss\n";
+    return 0;
+  }
+  /*****************************************************************/
+  /******************** Generazione codice oggetto *****************/
+  /*****************************************************************/
+  {
+    PhaseScope Scope(drv.timer, Phase::Optimize, "Optimize");
+    if (O.whole_program && internalize(*drv.module, O.exports, Source))
+      return 1;
+    if (O.batch)
+      batchWrappers(*drv.module);
+    if (O.emit_header)
+      collectPrototypes(*drv.module, Prototypes);
+    targetModule(*drv.module, O);
+    optimizeModule(*drv.module, TheTargetMachine.get(), O.OptLevel, O.lto, pgoOptions(O)); // Ottimizzazione dell'IR
+  }
+  PhaseScope Scope(drv.timer, Phase::Emit, "Emit");
+  Module &M = *drv.module;
+  if (O.emit_header && writeHeader(Base, Source, Prototypes))
+    return 1;
+  if (O.emit_ll && writeFile(Base + ".ll", sys::fs::OF_Text, [&](raw_fd_ostream &dest) {
+        M.print(dest, nullptr);
+        return false;
+      }))
+    return 1;
+  // Con -flto=thin il bitcode contiene anche il riassunto del modulo (simboli,
+  // chiamate, dimensioni delle funzioni) con cui il linker decide cosa
+  // importare e inlineare da un modulo all'altro
+  if (O.emit_bc && writeFile(Base + ".bc", sys::fs::OF_None, [&](raw_fd_ostream &dest) {
+        if (O.lto == LTOKind::Thin) {
+          ProfileSummaryInfo PSI(M);
+          ModuleSummaryIndex Index = buildModuleSummaryIndex(M, nullptr, &PSI);
+          WriteBitcodeToFile(M, dest, false, &Index);
+        } else
+          WriteBitcodeToFile(M, dest);
+        return false;
+      }))
+    return 1;
+  // La generazione del codice modifica il modulo: se servono sia l'assembly
+  // che l'oggetto, l'assembly viene prodotto da una copia
+  if (O.emit_asm) {
+    std::unique_ptr<Module> Copy = O.emit_obj ? CloneModule(M) : nullptr;
+    if (writeFile(Base + ".s", sys::fs::OF_Text, [&](raw_fd_ostream &dest) {
+          return emitCode(Copy ? *Copy : M, TheTargetMachine.get(), dest, CGFT_AssemblyFile);
+        }))
+      return 1;
+  }
+  if (O.emit_obj && writeFile(Base + ".o", sys::fs::OF_None, [&](raw_fd_ostream &dest) {
+        // Compilazione dell'IR prodotto dal frontend
+        return emitCode(M, TheTargetMachine.get(), dest, CGFT_ObjectFile);
+      }))
+    return 1;
+  return 0;
+}
+
+// Con -ftime-trace ogni job registra la propria traccia (il profiler di LLVM
+// è per thread) e la scrive in <Base>.json, o <sorgente>.json se non
+// vengono prodotti altri file
+static int compileJob(const Target *T, const std::string &TargetTriple, const Options &O,
+                      const std::string &Source, const std::string &Base) {
+  if (!O.time_trace)
+    return compileFile(T, TargetTriple, O, Source, Base);
+  timeTraceProfilerInitialize(O.trace_granularity, "kfe");
+  int res = compileFile(T, TargetTriple, O, Source, Base);
+  SmallString<128> Trace(Base);
+  if (Base == "") {
+    Trace = Source;
+    sys::path::replace_extension(Trace, "");
+  }
+  Trace += ".json";
+  if (writeFile(std::string(Trace), sys::fs::OF_Text, [](raw_fd_ostream &dest) {
+        timeTraceProfilerWrite(dest);
+        return false;
+      }))
+    res = 1;
+  timeTraceProfilerCleanup();
+  return res;
+}
 
 int main (int argc, char *argv[])
 {
   int res = 0;
-  driver drv;
   /***********************************************************************/
   /********* Inizializzazione del target (local machine) *****************/
   /***********************************************************************/
@@ -13,65 +910,370 @@ int main (int argc, char *argv[])
   InitializeAllTargetMCs();
   InitializeAllAsmParsers();
   InitializeAllAsmPrinters();
-  
-  auto TargetTriple = sys::getDefaultTargetTriple();
-  drv.module->setTargetTriple(TargetTriple);
-  std::string Error;
-  auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
-  if (!Target) {
-    errs() << Error;
-    return 1;
-  }
- /************************** Set-up macchina target ********************/
-  auto CPU = "generic";
-  auto Features = "";
-  TargetOptions opt;
-  auto RM = Optional<Reloc::Model>();
-  auto TheTargetMachine =
-      Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
-  /************************* Configurazione del modulo *****************/
-  drv.module->setDataLayout(TheTargetMachine->createDataLayout());
-  drv.module->setTargetTriple(TargetTriple);
-  /***********************************************************************/
-  /************* Fine set-up per creazione codice oggetto ****************/
-  /***********************************************************************/
+
   int i = 1;
+  Options O;
   std::string Filename = ""; // Il default è che il codice oggetto non viene generato
+  std::vector<std::string> Sources;
+  unsigned Jobs = 1;         // Numero di file compilati in parallelo
+  bool Run = false, Lazy = false;
+  std::string CachePolicy = "";
   while (i<argc) {
     if (argv[i] == std::string ("-p"))
-      drv.trace_parsing = true; // Abilita tracce debug nel parser
+      O.trace_parsing = true;   // Abilita tracce debug nel parser
     else if (argv[i] == std::string ("-s"))
-      drv.trace_scanning = true;// Abilita tracce debug nello scanner
+      O.trace_scanning = true;  // Abilita tracce debug nello scanner
     else if (argv[i] == std::string ("-v"))
-      drv.ast_print = true;     // Stampa una rapp. esterna dell'AST
-    else if (argv[i] == std::string ("-o"))
-      Filename = argv[++i]+(std::string)".o"; // Crea codice oggetto nel file indicato
-    else  if (!drv.parse(argv[i])) { // Parsing e creazione dell'AST
-      drv.codegen();                 // Visita AST e generazione dell'IR (su stdout)
-      if (Filename != "") {
-	/*****************************************************************/
-	/******************** Generazione codice oggetto *****************/
-  /*****************************************************************/
-	std::error_code EC;
-	raw_fd_ostream dest(Filename, EC, sys::fs::OF_None);
-	if (EC) {
-	  errs() << "Could not open file: " << EC.message();
-	  return 1;
-	}
-	legacy::PassManager pass;
-	auto FileType = CGFT_ObjectFile;
-	if (TheTargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
-	  errs() << "TheTargetMachine can't emit a file of this type";
-	  return 1;
-	}
-	pass.run(*drv.module); // Compilazione dell'IR prodotto dal frontend
-	dest.flush();
-	outs() << "Wrote " << Filename << "\n";
-	return 0;
+      O.ast_print = true;       // Stampa una rapp. esterna dell'AST
+    else if (argv[i] == std::string ("--mem-stats"))
+      O.mem_stats = true;       // Statistiche di memoria dell'arena dell'AST
+    else if (argv[i] == std::string ("--stdio-input"))
+      O.stdio_input = true;     // Legge il sorgente con stdio invece di mmap
+    else if (argv[i] == std::string ("--scan-only"))
+      O.scan_only = true;       // Misura il throughput del solo scanner
+    else if (argv[i] == std::string ("--parse-only"))
+      O.parse_only = true;      // Misura il throughput del solo parser
+    else if (argv[i] == std::string ("--stream"))
+      O.stream = true;          // Codegen in streaming, memoria limitata
+    else if (argv[i] == std::string ("--print-ir"))
+      O.print_ir = true;        // Stampa l'IR di ogni funzione su stderr
+    else if (argv[i] == std::string ("-fno-simplify"))
+      O.simplify = false;       // Genera l'AST così com'è, senza semplificarlo
+    else if (argv[i] == std::string ("-o")) {
+      if (i + 1 == argc) {
+        errs() << "-o requires a file name\n";
+        return 1;
+      }
+      Filename = argv[++i];     // Nome base dei file prodotti (<nome>.o, ...)
+    } else if (argv[i] == std::string ("-c"))
+      O.emit_obj = true;        // Codice oggetto (implicito se non si chiede altro)
+    else if (argv[i] == std::string ("-emit-llvm"))
+      O.emit_ll = true;         // IR testuale (.ll)
+    else if (argv[i] == std::string ("-S"))
+      O.emit_asm = true;        // Assembly (.s)
+    else if (argv[i] == std::string ("-emit-bc"))
+      O.emit_bc = true;         // Bitcode (.bc)
+    else if (argv[i] == std::string ("--batch"))
+      O.batch = true;           // Versioni <f>_batch su array, vettorizzate
+    else if (argv[i] == std::string ("-emit-header"))
+      O.emit_header = true;     // Prototipi extern "C" delle funzioni (.h)
+    else if (argv[i] == std::string ("-flto") || argv[i] == std::string ("-flto=full"))
+      O.lto = LTOKind::Full;    // L'oggetto diventa bitcode per la LTO del linker
+    else if (argv[i] == std::string ("-flto=thin"))
+      O.lto = LTOKind::Thin;    // ... con il riassunto per la ThinLTO
+    else if (argv[i] == std::string ("-fprofile-generate"))
+      O.profile_generate = "default.profraw"; // Codice strumentato per PGO
+    else if (std::string (argv[i]).rfind ("-fprofile-generate=", 0) == 0)
+      O.profile_generate = argv[i]+19;
+    else if (std::string (argv[i]).rfind ("-fprofile-use=", 0) == 0)
+      O.profile_use = argv[i]+14;   // Ottimizzazione guidata dal profilo
+    else if (argv[i] == std::string ("-ftime-report"))
+      O.time_report = true;     // Tempi delle singole fasi su stderr
+    else if (argv[i] == std::string ("-ftime-trace"))
+      O.time_trace = true;      // Traccia JSON per chrome://tracing o Perfetto
+    else if (std::string (argv[i]).rfind ("-ftime-trace-granularity=", 0) == 0)
+      O.trace_granularity = atoi(argv[i]+25);
+    else if (argv[i] == std::string ("-ffast-math")) {
+      O.fmf.setFast();          // Tutte le ottimizzazioni non IEEE, FMA comprese
+      O.fp_contract = FPContract::Fast;
+    } else if (argv[i] == std::string ("-fno-fast-math")) {
+      O.fmf.clear();            // Semantica IEEE stretta (il default)
+      O.fp_contract = FPContract::Off;
+    } else if (argv[i] == std::string ("-ffp-contract=fast")) {
+      O.fmf.setAllowContract(); // a*b+c diventa una FMA anche tra espressioni diverse
+      O.fp_contract = FPContract::Fast;
+    } else if (argv[i] == std::string ("-ffp-contract=on")) {
+      O.fmf.setAllowContract(false);
+      O.fp_contract = FPContract::On; // ... solo all'interno di un'espressione
+    } else if (argv[i] == std::string ("-ffp-contract=off")) {
+      O.fmf.setAllowContract(false);
+      O.fp_contract = FPContract::Off;
+    } else if (argv[i] == std::string ("-fassociative-math"))
+      O.fmf.setAllowReassoc();  // Riassociazione (es. riduzioni vettorizzate)
+    else if (argv[i] == std::string ("-freciprocal-math"))
+      O.fmf.setAllowReciprocal(); // x/y come x*(1/y)
+    else if (argv[i] == std::string ("-fno-signed-zeros"))
+      O.fmf.setNoSignedZeros(); // -0.0 equivale a +0.0
+    else if (argv[i] == std::string ("-fno-honor-nans"))
+      O.fmf.setNoNaNs();        // Nessun operando o risultato NaN
+    else if (argv[i] == std::string ("-fno-honor-infinities"))
+      O.fmf.setNoInfs();        // Nessun operando o risultato infinito
+    else if (argv[i] == std::string ("-ffinite-math-only")) {
+      O.fmf.setNoNaNs();
+      O.fmf.setNoInfs();
+    } else if (argv[i] == std::string ("-fapprox-func"))
+      O.fmf.setApproxFunc();    // Funzioni matematiche approssimate
+    else if (std::string (argv[i]).rfind ("-mcpu=", 0) == 0)
+      O.cpu = argv[i]+6;        // CPU target; "native" è quella dell'host
+    else if (std::string (argv[i]).rfind ("-mattr=", 0) == 0)
+      O.features = argv[i]+7;   // Feature target, es. +avx2,+fma
+    else if (std::string (argv[i]).rfind ("-mversions=", 0) == 0) {
+      SmallVector<StringRef, 4> Vs;
+      StringRef(argv[i]+11).split(Vs, ',', -1, false);
+      for (StringRef V : Vs)
+        O.versions.push_back(V.str());  // Una versione di ogni funzione per CPU
+    } else if (argv[i] == std::string ("--whole-program"))
+      O.whole_program = true;   // Definizioni non esportate interne, quelle inutili eliminate
+    else if (std::string (argv[i]).rfind ("--export=", 0) == 0) {
+      SmallVector<StringRef, 4> Es;
+      StringRef(argv[i]+9).split(Es, ',', -1, false);
+      for (StringRef E : Es)
+        O.exports.push_back(E.str());  // Funzioni visibili dall'esterno con --whole-program
+    } else if (std::string (argv[i]).rfind ("--cache-dir=", 0) == 0)
+      O.cache_dir = argv[i]+12; // Cache degli oggetti di ogni funzione (implica --stream)
+    else if (std::string (argv[i]).rfind ("--cache-policy=", 0) == 0)
+      CachePolicy = argv[i]+15; // Limiti della cache, es. cache_size_bytes=1g
+    else if (argv[i] == std::string ("-j")) {
+      if (i + 1 == argc) {
+        errs() << "-j requires a number of jobs\n";
+        return 1;
       }
+      Jobs = std::max(1, atoi(argv[++i]));    // Compilazione parallela di più file
+    } else if (std::string (argv[i]).rfind ("-j", 0) == 0)
+      Jobs = std::max(1, atoi(argv[i]+2));
+    else if (argv[i] == std::string ("--run"))
+      Run = true;               // Esegue le espressioni top-level con il JIT
+    else if (argv[i] == std::string ("--lazy"))
+      Run = Lazy = true;        // Compila le funzioni alla prima chiamata
+    else if (argv[i] == std::string ("-O0")) {
+      O.OptLevel = OptimizationLevel::O0;     // Livelli di ottimizzazione dell'IR
+      O.CGLevel = CodeGenOpt::None;
+    } else if (argv[i] == std::string ("-O1")) {
+      O.OptLevel = OptimizationLevel::O1;
+      O.CGLevel = CodeGenOpt::Less;
+    } else if (argv[i] == std::string ("-O2") || argv[i] == std::string ("-O")) {
+      O.OptLevel = OptimizationLevel::O2;
+      O.CGLevel = CodeGenOpt::Default;
+    } else if (argv[i] == std::string ("-O3")) {
+      O.OptLevel = OptimizationLevel::O3;
+      O.CGLevel = CodeGenOpt::Aggressive;
     } else
-      res = 1;
+      Sources.push_back(argv[i]);
     i++;
   };
-  return res;
+
+  /******************** Esecuzione con il JIT (--run) ********************/
+  // Tutti i file vengono eseguiti nello stesso driver, così le definizioni
+  // di un file sono visibili nei file successivi
+  if (Run) {
+    if (O.whole_program) {
+      errs() << "--whole-program cannot be used with --run\n";
+      return 1;
+    }
+    if (!O.profile_generate.empty() || !O.profile_use.empty()) {
+      errs() << "-fprofile-generate and -fprofile-use cannot be used with --run\n";
+      return 1;
+    }
+    driver drv;
+    drv.trace_parsing = O.trace_parsing;
+    drv.trace_scanning = O.trace_scanning;
+    drv.stdio_input = O.stdio_input;
+    drv.ast_print = O.ast_print;
+    drv.mem_stats = O.mem_stats;
+    drv.print_ir = O.print_ir;
+    drv.simplify = O.simplify;
+    drv.fmf = O.fmf;
+    drv.fp_contract = O.fp_contract;
+    drv.lazy = Lazy;
+    drv.streaming = O.stream;
+    drv.timer.enabled = O.time_report;
+    if (O.time_trace)
+      timeTraceProfilerInitialize(O.trace_granularity, "kfe");
+    if (drv.initJIT())
+      return 1;
+    // Con -O1..-O3 ogni modulo viene ottimizzato per la CPU dell'host, come
+    // quelli compilati in un file oggetto, prima di essere ceduto al JIT
+    std::unique_ptr<TargetMachine> JitTM;
+    if (O.OptLevel != OptimizationLevel::O0) {
+      auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+      auto TM = JTMB ? JTMB->setCodeGenOptLevel(O.CGLevel).createTargetMachine()
+                     : Expected<std::unique_ptr<TargetMachine>>(JTMB.takeError());
+      if (!TM) {
+        logAllUnhandledErrors(TM.takeError(), errs(), "Impossibile creare il JIT: ");
+        return 1;
+      }
+      JitTM = std::move(*TM);
+      drv.jitOptimize = [&](Module &M) { optimizeModule(M, JitTM.get(), O.OptLevel); };
+    }
+    for (auto &Source : Sources) {
+      if (!drv.parse(Source)) // Parsing e creazione dell'AST
+        drv.codegen();        // Generazione dell'IR ed esecuzione
+      else
+        res = 1;
+    }
+    if (O.time_report)
+      drv.timer.report(errs(), "--run");
+    if (O.time_trace && !Sources.empty()) {
+      SmallString<128> Trace(Sources[0]);
+      sys::path::replace_extension(Trace, "json");
+      if (writeFile(std::string(Trace), sys::fs::OF_Text, [](raw_fd_ostream &dest) {
+            timeTraceProfilerWrite(dest);
+            return false;
+          }))
+        res = 1;
+      timeTraceProfilerCleanup();
+    }
+    return res;
+  }
+
+  auto TargetTriple = sys::getDefaultTargetTriple();
+  std::string Error;
+  auto Target = TargetRegistry::lookupTarget(TargetTriple, Error);
+  if (!Target) {
+    errs() << Error;
+    return 1;
+  }
+
+  // Con -mcpu=native la CPU e le feature sono quelle dell'host (le feature
+  // indicate con -mattr vengono aggiunte dopo, e quindi prevalgono)
+  if (O.cpu == "native") {
+    O.cpu = sys::getHostCPUName().str();
+    StringMap<bool> HostFeatures;
+    std::vector<std::string> Host;
+    if (sys::getHostCPUFeatures(HostFeatures))
+      for (auto &F : HostFeatures)
+        Host.push_back((F.second ? "+" : "-") + F.first().str());
+    llvm::sort(Host);
+    if (!O.features.empty())
+      Host.push_back(O.features);
+    O.features = join(Host, ",");
+  }
+  std::unique_ptr<MCSubtargetInfo> STI(Target->createMCSubtargetInfo(TargetTriple, "", ""));
+  if (!STI->isCPUStringValid(O.cpu)) {
+    errs() << "-mcpu: unknown CPU '" << O.cpu << "' for " << TargetTriple << "\n";
+    return 1;
+  }
+  if (!O.versions.empty() && Triple(TargetTriple).getArch() != Triple::x86_64) {
+    errs() << "-mversions is only supported on x86-64\n";
+    return 1;
+  }
+  for (const std::string &V : O.versions) {
+    CpuTest T;
+    std::string Missing;
+    if (X86::parseArchX86(V, true) == X86::CK_None) {
+      errs() << "-mversions: unsupported CPU '" << V << "'\n";
+      return 1;
+    }
+    if (!cpuFeatureTest(V, T, Missing)) {
+      errs() << "-mversions: CPU '" << V << "' requires feature '" << Missing
+             << "', which cannot be checked at load time\n";
+      return 1;
+    }
+  }
+
+  /******************** Compilazione dei file sorgente *******************/
+  // Con un solo file i prodotti hanno il nome indicato con -o (o quello del
+  // sorgente, se si chiede solo -emit-llvm, -S o -emit-bc); con più file
+  // ciascuno viene compilato nel proprio <nome>.o. In modalità streaming
+  // l'oggetto è un archivio (.a)
+  if (Sources.size() > 1 && Filename != "") {
+    errs() << "-o can only be used with a single source file\n";
+    return 1;
+  }
+  // La cache lavora sugli oggetti delle singole funzioni, prodotti come
+  // con --stream; la chiave dipende anche dall'eseguibile di kfe (percorso,
+  // dimensione e data di modifica, come fa ccache)
+  Expected<CachePruningPolicy> Policy = parseCachePruningPolicy(CachePolicy);
+  if (!Policy) {
+    logAllUnhandledErrors(Policy.takeError(), errs(), "--cache-policy: ");
+    return 1;
+  }
+  if (O.cache_dir != "") {
+    O.stream = true;
+    std::string Exe = sys::fs::getMainExecutable(argv[0], (void *)&main);
+    sys::fs::file_status Status;
+    sys::fs::status(Exe, Status);
+    O.compiler_id = Exe + " " + std::to_string(Status.getSize()) + " " +
+                    std::to_string(Status.getLastModificationTime().time_since_epoch().count());
+  }
+  bool Explicit = O.emit_ll || O.emit_asm || O.emit_bc;
+  if (O.stream && Explicit) {
+    errs() << "-emit-llvm, -S and -emit-bc cannot be used with --stream or --cache-dir\n";
+    return 1;
+  }
+  if (O.whole_program && (O.stream || Sources.size() > 1 || O.exports.empty())) {
+    errs() << "--whole-program requires --export and a single source file, "
+              "and cannot be used with --stream or --cache-dir\n";
+    return 1;
+  }
+  if (!O.whole_program && !O.exports.empty()) {
+    errs() << "--export requires --whole-program\n";
+    return 1;
+  }
+  if (O.stream && O.lto != LTOKind::None) {
+    errs() << "-flto cannot be used with --stream or --cache-dir\n";
+    return 1;
+  }
+  // Con la cache le definizioni trovate non passano dal codegen, quindi
+  // mancherebbero nell'header
+  if (O.cache_dir != "" && O.emit_header) {
+    errs() << "-emit-header cannot be used with --cache-dir\n";
+    return 1;
+  }
+  if (!O.profile_generate.empty() && !O.profile_use.empty()) {
+    errs() << "-fprofile-generate and -fprofile-use cannot be used together\n";
+    return 1;
+  }
+  // Il profilo viene controllato subito: deve essere quello indicizzato
+  // prodotto da llvm-profdata merge (non il .profraw scritto dal programma)
+  if (!O.profile_use.empty()) {
+    auto Reader = IndexedInstrProfReader::create(O.profile_use);
+    if (!Reader) {
+      logAllUnhandledErrors(Reader.takeError(), errs(), "-fprofile-use: " + O.profile_use + ": ");
+      return 1;
+    }
+    if (!(*Reader)->isIRLevelProfile()) {
+      errs() << "-fprofile-use: " << O.profile_use << " is not an IR-level profile\n";
+      return 1;
+    }
+    if (auto Buffer = MemoryBuffer::getFile(O.profile_use))
+      O.profile_id = toHex(MD5::hash(arrayRefFromStringRef((*Buffer)->getBuffer())));
+  }
+  if (!Explicit && (Filename != "" || Sources.size() > 1))
+    O.emit_obj = true;
+  std::vector<std::string> Outputs;
+  for (auto &Source : Sources) {
+    if (Sources.size() == 1 && Filename != "") {
+      Outputs.push_back(Filename);
+      continue;
+    }
+    if (!O.emit_obj && !Explicit && !O.emit_header) {
+      Outputs.push_back("");
+      continue;
+    }
+    SmallString<128> Out(Source);
+    sys::path::replace_extension(Out, "");
+    Outputs.push_back(std::string(Out));
+  }
+  // Con -flto al posto del codice oggetto viene scritto il bitcode
+  if (O.lto != LTOKind::None && O.emit_obj) {
+    O.emit_obj = false;
+    O.emit_bc = true;
+  }
+
+  // I job vengono distribuiti su un pool di Jobs thread
+  std::atomic<size_t> Next(0);
+  std::atomic<int> Failed(0);
+  auto Worker = [&]() {
+    size_t k;
+    while ((k = Next++) < Sources.size())
+      if (compileJob(Target, TargetTriple, O, Sources[k], Outputs[k]))
+        Failed = 1;
+  };
+  Jobs = std::min<size_t>(Jobs, Sources.size());
+  if (Jobs <= 1)
+    Worker();
+  else {
+    std::vector<std::thread> Pool;
+    for (unsigned j = 0; j < Jobs; ++j)
+      Pool.emplace_back(Worker);
+    for (auto &Th : Pool)
+      Th.join();
+  }
+  // Eliminazione dei file meno usati di recente secondo la politica indicata
+  // (di default al più ogni 20 minuti, oltre una settimana senza accessi o il
+  // 75% dello spazio libero su disco)
+  if (O.cache_dir != "")
+    pruneCache(O.cache_dir, *Policy);
+  return Failed ? 1 : res;
 }
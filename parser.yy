@@ -1,5 +1,5 @@
 %skeleton "lalr1.cc" /* -*- C++ -*- */
-%require "3.2"
+%require "3.6"
 %defines
 
 %define api.token.constructor
@@ -11,6 +11,7 @@
   # include <string>
   #include <exception>
   class driver;
+  struct Symbol;
   class RootAST;
   class ExprAST;
   class FunctionAST;
@@ -20,8 +21,32 @@
   class IfExprAST;
   class UnaryExprAST;
   class ForExprAST;
+  class ParForExprAST;
   class VarExprAST;
   class WhileExprAST;
+  class IndexExprAST;
+
+  // Annotazioni facoltative di for e while, prima di "in":
+  // unroll(N), vectorize(W), interleave(N), independent
+  struct LoopHints {
+    unsigned unroll = 0;      // 1 disabilita l'unrolling
+    unsigned vectorize = 0;   // Larghezza; 1 disabilita la vettorizzazione
+    unsigned interleave = 0;
+    bool independent = false; // Nessuna dipendenza tra iterazioni
+  };
+
+  // Tipo di parametri, variabili e contatori dei for: double (default)
+  // o intero con segno a 64 bit ("int" o "i64")
+  enum class VarType { Double, Int };
+
+  // Nome con l'annotazione di tipo facoltativa "nome:tipo". I parametri
+  // possono essere puntatori ("nome:tipo*"), le variabili array ("nome[N]")
+  struct TypedName {
+    Symbol *name = nullptr;
+    VarType type = VarType::Double;
+    bool pointer = false;
+    unsigned size = 0;        // Numero di elementi, 0 se non è un array
+  };
 }
 
 // The parsing context.
@@ -34,6 +59,17 @@
 
 %code {
 # include "driver.hh"
+# include <climits>
+# include <cmath>
+
+// Converte V in N se è un intero tra 1 e UINT_MAX. Il controllo va fatto sul
+// double: convertire in unsigned un valore fuori intervallo non è definito
+static bool positiveUnsigned(double V, unsigned &N) {
+  if (!(V >= 1 && V <= UINT_MAX && V == std::floor(V)))
+    return false;
+  N = V;
+  return true;
+}
 }
 
 %define api.token.prefix {TOK_}
@@ -76,20 +112,31 @@
 
   // ********** Estensione 5 **********
   WHILE      "while"
+
+  // ********** Parfor **********
+  PARFOR     "parfor"
+
+  // ********** Array **********
+  LBRACKET   "["
+  RBRACKET   "]"
 ;
 
-%token <std::string> IDENTIFIER "id"
+%token <Symbol*> IDENTIFIER "id"
 %token <double> NUMBER "number"
 %type <ExprAST*> exp
 %type <ExprAST*> idexp
 %type <std::vector<ExprAST*>> optexp
 %type <std::vector<ExprAST*>> explist
-%type <RootAST*> program
+%type <std::vector<RootAST*>> program
 %type <RootAST*> top
 %type <FunctionAST*> definition
 %type <PrototypeAST*> external
 %type <PrototypeAST*> proto
-%type <std::vector<std::string>> idseq
+%type <std::vector<TypedName>> idseq
+%type <TypedName> typedid
+%type <TypedName> param
+%type <VarType> vartype
+%type <VarType> arraytype
 
 // ********** Estensione 1 **********
 %type <IfExprAST*> ifexpr
@@ -100,11 +147,15 @@
 // ********** Estensione 3 **********
 %type <ForExprAST*> forexpr
 %type <ExprAST*> step
+%type <LoopHints> hints
+
+// ********** Parfor **********
+%type <ParForExprAST*> parforexpr
 
 // ********** Estensione 4 **********
 %type <VarExprAST*> varexpr
-%type <std::vector<std::pair<std::string, ExprAST*>>> varlist
-%type <std::pair<std::string, ExprAST*>> pair
+%type <std::vector<std::pair<TypedName, ExprAST*>>> varlist
+%type <std::pair<TypedName, ExprAST*>> pair
 
 // ********** Estensione 5 **********
 %type <WhileExprAST*> whileexpr
@@ -113,11 +164,18 @@
 %start startsymb;
 
 startsymb:
-program             { drv.root = $1; }
+program             { drv.root = drv.arena.make<SeqAST>(std::move($1)); }
 
+// Le liste sono ricorsive a sinistra: gli elementi vengono aggiunti in coda
+// (e i vettori spostati, non copiati), così il parsing è lineare e la pila
+// del parser non cresce con la lunghezza della lista
 program:
-  %empty               { $$ = new SeqAST(nullptr,nullptr); }
-|  top ";" program     { $$ = new SeqAST($1,$3); };
+  %empty               { }
+| program top ";"      { $$ = std::move($1);
+                         if ($2) {
+                           if (drv.streaming) drv.stream($2); // Generato e liberato subito
+                           else $$.push_back($2);
+                         } };
 
 top:
 %empty                 { $$ = nullptr; }
@@ -125,19 +183,44 @@ top:
 | external             { $$ = $1; }
 | exp                  { $$ = $1; $1->toggle(); };
 
+// "fastmath def" rilassa la semantica IEEE solo nella funzione definita
 definition:
-  "def" proto exp      { $$ = new FunctionAST($2,$3); $2->noemit(); };
+  "def" proto exp      { $$ = drv.arena.make<FunctionAST>($2,$3); $2->noemit(); }
+| "id" "def" proto exp { if ($1->name != "fastmath") {
+                           error(@1, "qualificatore sconosciuto: " + $1->name.str());
+                           YYERROR;
+                         }
+                         $$ = drv.arena.make<FunctionAST>($3,$4);
+                         $$->setFastMath();
+                         $3->noemit(); };
 
 external:
   "extern" proto       { $$ = $2; };
 
 proto:
-  "id" "(" idseq ")"   { $$ = new PrototypeAST($1,$3); };
+  "id" "(" idseq ")"   { $$ = drv.arena.make<PrototypeAST>($1,std::move($3)); };
 
 idseq:
-  %empty               { std::vector<std::string> args;
-                         $$ = args; }
-| "id" idseq           { $2.insert($2.begin(),$1); $$ = $2; };
+  %empty               { }
+| idseq param          { $$ = std::move($1); $$.push_back($2); };
+
+// Un parametro "nome:tipo*" riceve un buffer dal chiamante (senza copia)
+param:
+  typedid              { $$ = $1; }
+| "id" ":" vartype "*" { $$ = TypedName{$1, $3, true}; };
+
+typedid:
+  "id"                 { $$ = TypedName{$1, VarType::Double}; }
+| "id" ":" vartype     { $$ = TypedName{$1, $3}; };
+
+// Come per le annotazioni dei loop, i nomi dei tipi non sono parole chiave
+vartype:
+  "id"                 { if ($1->name == "double") $$ = VarType::Double;
+                         else if ($1->name == "int" || $1->name == "i64") $$ = VarType::Int;
+                         else {
+                           error(@1, "tipo sconosciuto: " + $1->name.str());
+                           YYERROR;
+                         } };
 
 %left ":";
 %left "=";
@@ -146,94 +229,126 @@ idseq:
 %left "*" "/";
 
 exp:
-  exp "+" exp          { $$ = new BinaryExprAST('+',$1,$3); }
-| exp "-" exp          { $$ = new BinaryExprAST('-',$1,$3); }
-| exp "*" exp          { $$ = new BinaryExprAST('*',$1,$3); }
-| exp "/" exp          { $$ = new BinaryExprAST('/',$1,$3); }
+  exp "+" exp          { $$ = drv.arena.make<BinaryExprAST>('+',$1,$3); }
+| exp "-" exp          { $$ = drv.arena.make<BinaryExprAST>('-',$1,$3); }
+| exp "*" exp          { $$ = drv.arena.make<BinaryExprAST>('*',$1,$3); }
+| exp "/" exp          { $$ = drv.arena.make<BinaryExprAST>('/',$1,$3); }
 
 // ********** Estensione 1 **********
-| exp "<" exp          { $$ = new BinaryExprAST('<',$1,$3); }
-| exp ">" exp          { $$ = new BinaryExprAST('>',$1,$3); }
-| exp "<=" exp         { $$ = new BinaryExprAST('l',$1,$3); }
-| exp ">=" exp         { $$ = new BinaryExprAST('g',$1,$3); }
-| exp "==" exp         { $$ = new BinaryExprAST('E',$1,$3); }
-| exp "!=" exp         { $$ = new BinaryExprAST('N',$1,$3); }
+| exp "<" exp          { $$ = drv.arena.make<BinaryExprAST>('<',$1,$3); }
+| exp ">" exp          { $$ = drv.arena.make<BinaryExprAST>('>',$1,$3); }
+| exp "<=" exp         { $$ = drv.arena.make<BinaryExprAST>('l',$1,$3); }
+| exp ">=" exp         { $$ = drv.arena.make<BinaryExprAST>('g',$1,$3); }
+| exp "==" exp         { $$ = drv.arena.make<BinaryExprAST>('E',$1,$3); }
+| exp "!=" exp         { $$ = drv.arena.make<BinaryExprAST>('N',$1,$3); }
 
 | ifexpr               { $$ = $1; }
 
 // ********** Estensione 2 **********
 | unaryexpr            { $$ = $1; }
-| exp ":" exp          { $$ = new BinaryExprAST(':', $1,$3); }
+| exp ":" exp          { $$ = drv.arena.make<BinaryExprAST>(':', $1,$3); }
 
 // ********** Estensione 3 **********
 | forexpr              { $$ = $1; }
+| parforexpr           { $$ = $1; }
 
 | idexp                { $$ = $1; }
 | "(" exp ")"          { $$ = $2; }
-| "number"             { $$ = new NumberExprAST($1); };
+| "number"             { $$ = drv.arena.make<NumberExprAST>($1); };
 
 // ********** Estensione 4 **********
-| "id" "=" exp          { $$ = new BinaryExprAST('=',new VariableExprAST($1), $3); } 
+| "id" "=" exp          { $$ = drv.arena.make<BinaryExprAST>('=',drv.arena.make<VariableExprAST>($1), $3); } 
 | varexpr              { $$ = $1; };
 
 // ********** Estensione 5 **********
 | whileexpr            { $$ = $1; }
 
 idexp:
-  "id"                 { $$ = new VariableExprAST($1); }
-| "id" "(" optexp ")"  { $$ = new CallExprAST($1,$3); };
+  "id"                 { $$ = drv.arena.make<VariableExprAST>($1); }
+| "id" "(" optexp ")"  { $$ = drv.arena.make<CallExprAST>($1,std::move($3)); }
+| "id" "[" exp "]"     { $$ = drv.arena.make<IndexExprAST>($1,$3); }
+| "id" "[" exp "]" "=" exp { $$ = drv.arena.make<IndexExprAST>($1,$3,$6); };
 
 optexp:
-%empty                 { std::vector<ExprAST*> args;
-                         args.push_back(nullptr);
-			 $$ = args;
-                       }
-| explist              { $$ = $1; };
+%empty                 { }
+| explist              { $$ = std::move($1); };
 
 explist:
-  exp                  { std::vector<ExprAST*> args;
-                         args.push_back($1);
-			 $$ = args;
-                       }
-| exp "," explist      { $3.insert($3.begin(), $1); $$ = $3; };
+  exp                  { $$.push_back($1); }
+| explist "," exp      { $$ = std::move($1); $$.push_back($3); };
 
 // ********** Estensione 1 **********
 ifexpr:
-  "if" exp "then" exp "else" exp "end" {$$ = new IfExprAST($2, $4, $6); };
+  "if" exp "then" exp "else" exp "end" {$$ = drv.arena.make<IfExprAST>($2, $4, $6); };
 
 // ********** Estensione 2 **********
 unaryexpr:
-  "-" exp              { $$ = new UnaryExprAST('-', $2); }
-| "+" exp              { $$ = new UnaryExprAST('+', $2); };
+  "-" exp              { $$ = drv.arena.make<UnaryExprAST>('-', $2); }
+| "+" exp              { $$ = drv.arena.make<UnaryExprAST>('+', $2); };
 
 // ********** Estensione 3 **********
 forexpr:
-  "for" "id" "=" exp "," exp step "in" exp "end"         { $$ = new ForExprAST($2, $4, $6, $7, $9); };
+  "for" typedid "=" exp "," exp step hints "in" exp "end"   { $$ = drv.arena.make<ForExprAST>($2, $4, $6, $7, $10, $8); };
 
 step:
   %empty                   { $$ = nullptr; }
 | "," exp                  { $$ = $2; };
 
+// I nomi delle annotazioni non sono parole chiave: restano utilizzabili come identificatori
+hints:
+  %empty                   { }
+| hints "id"               { $$ = $1;
+                             if ($2->name != "independent") {
+                               error(@2, "annotazione di loop sconosciuta: " + $2->name.str());
+                               YYERROR;
+                             }
+                             $$.independent = true; }
+| hints "id" "(" "number" ")" { $$ = $1;
+                             unsigned N;
+                             if (!positiveUnsigned($4, N)) {
+                               error(@4, "il parametro di " + $2->name.str() + " deve essere un intero positivo");
+                               YYERROR;
+                             }
+                             if ($2->name == "unroll") $$.unroll = N;
+                             else if ($2->name == "vectorize") $$.vectorize = N;
+                             else if ($2->name == "interleave") $$.interleave = N;
+                             else {
+                               error(@2, "annotazione di loop sconosciuta: " + $2->name.str());
+                               YYERROR;
+                             } };
+
+// ********** Parfor **********
+// A differenza del for il secondo estremo non è una condizione: le
+// iterazioni vanno da a (incluso) a b (escluso), con passo positivo
+parforexpr:
+  "parfor" typedid "=" exp "," exp step "in" exp "end"      { $$ = drv.arena.make<ParForExprAST>($2, $4, $6, $7, $9); };
 
 // ********** Estensione 4 **********
 varexpr:
-  "var" varlist "in" exp "end"     { $$ = new VarExprAST($2, $4); };
+  "var" varlist "in" exp "end"     { $$ = drv.arena.make<VarExprAST>(std::move($2), $4); };
 
 varlist:
-  pair                              { std::vector<std::pair<std::string, ExprAST*>> args; // Gestisce il caso in cui c'è solo una coppia <variableName, id>
-                                      args.push_back($1);   // Aggiunge infondo al vettore "args" $1
-			                                $$ = args;     // Valore di ritorno in $$
-                                    }
-| pair "," varlist                  { $3.insert($3.begin(), $1); $$ = $3; };    // Effettua un "append" di $1 all'inizio del vettore $3
+  pair                              { $$.push_back($1); }   // Gestisce il caso in cui c'è solo una coppia <variableName, id>
+| varlist "," pair                  { $$ = std::move($1); $$.push_back($3); };    // Aggiunge $3 in fondo al vettore $1
 
 pair:           
-  "id"                              { $$ = std::make_pair($1,nullptr); }    // Gestisco il caso "var a"
-| "id" "=" exp                      { $$ = std::make_pair($1,$3); }         // Gestisco il caso "var a = 1"
+  typedid                           { $$ = std::make_pair($1,nullptr); }    // Gestisco il caso "var a" (o "var a:int")
+| typedid "=" exp                   { $$ = std::make_pair($1,$3); }         // Gestisco il caso "var a = 1"
+| "id" "[" "number" "]" arraytype   { unsigned N;                           // Array locale "var a[N]" (o "var a[N]:int")
+                                      if (!positiveUnsigned($3, N)) {
+                                        error(@3, "la dimensione di un array deve essere un intero positivo");
+                                        YYERROR;
+                                      }
+                                      $$ = std::make_pair(TypedName{$1, $5, false, N}, nullptr); };
+
+arraytype:
+  %empty                            { $$ = VarType::Double; }
+| ":" vartype                       { $$ = $2; };
 
 
 // ********** Estensione 5 **********
 whileexpr:
-  "while" exp "in" exp "end"  {$$ = new WhileExprAST($2, $4); };
+  "while" exp hints "in" exp "end"  {$$ = drv.arena.make<WhileExprAST>($2, $5, $3); };
 
 %%
 
@@ -0,0 +1,207 @@
+// Runtime dei programmi kfe: pool di thread work-stealing per i cicli parfor
+#include "kfe_runtime.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Range {
+  int64_t Lo, Hi;
+};
+
+// Intervalli di iterazioni di un worker. Il proprietario inserisce e preleva
+// in testa (gli intervalli più piccoli, appena suddivisi), gli altri worker
+// rubano in coda (i più grandi)
+class WorkQueue {
+private:
+  std::mutex M;
+  std::deque<Range> Q;
+
+public:
+  void push(Range R) {
+    std::lock_guard<std::mutex> L(M);
+    Q.push_front(R);
+  }
+  bool pop(Range &R) {
+    std::lock_guard<std::mutex> L(M);
+    if (Q.empty())
+      return false;
+    R = Q.front();
+    Q.pop_front();
+    return true;
+  }
+  bool steal(Range &R) {
+    std::lock_guard<std::mutex> L(M);
+    if (Q.empty())
+      return false;
+    R = Q.back();
+    Q.pop_back();
+    return true;
+  }
+};
+
+// Vero nei thread che stanno eseguendo un parfor: un parfor annidato viene
+// eseguito sequenzialmente invece di attendere il pool (che è occupato)
+thread_local bool InWorker = false;
+
+// Il thread chiamante partecipa come worker 0; gli altri worker attendono
+// un nuovo job (Generation) e segnalano la fine con Busy
+class Pool {
+private:
+  std::vector<std::thread> Threads;
+  std::vector<std::unique_ptr<WorkQueue>> Queues;
+  std::mutex JobMutex; // Un parfor alla volta tra i thread dell'applicazione
+  std::mutex M;
+  std::condition_variable Wake, Done;
+  uint64_t Generation = 0;
+  unsigned Busy = 0;
+  bool Stop = false;
+
+  // Job corrente
+  kfe_parfor_body Body = nullptr;
+  void *Env = nullptr;
+  int64_t Grain = 1;
+  std::atomic<int64_t> Remaining{0};
+  std::vector<double> Partial;
+
+  bool steal(unsigned Self, Range &R) {
+    unsigned N = Queues.size();
+    for (unsigned I = 1; I < N; ++I)
+      if (Queues[(Self + I) % N]->steal(R))
+        return true;
+    return false;
+  }
+
+  // Gli intervalli vengono divisi a metà finché superano Grain: la metà
+  // superiore torna in coda, dove può essere rubata
+  void work(unsigned Self) {
+    WorkQueue &Own = *Queues[Self];
+    double Sum = 0;
+    Range R;
+    while (Remaining.load(std::memory_order_acquire) > 0) {
+      if (!Own.pop(R) && !steal(Self, R)) {
+        std::this_thread::yield();
+        continue;
+      }
+      while (R.Hi - R.Lo > Grain) {
+        int64_t Mid = R.Lo + (R.Hi - R.Lo) / 2;
+        Own.push(Range{Mid, R.Hi});
+        R.Hi = Mid;
+      }
+      Sum += Body(Env, R.Lo, R.Hi);
+      Remaining.fetch_sub(R.Hi - R.Lo, std::memory_order_acq_rel);
+    }
+    Partial[Self] = Sum;
+  }
+
+  void loop(unsigned Self) {
+    InWorker = true;
+    uint64_t Seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> L(M);
+        Wake.wait(L, [&] { return Stop || Generation != Seen; });
+        if (Stop)
+          return;
+        Seen = Generation;
+      }
+      work(Self);
+      std::lock_guard<std::mutex> L(M);
+      if (--Busy == 0)
+        Done.notify_one();
+    }
+  }
+
+public:
+  explicit Pool(unsigned N) {
+    for (unsigned I = 0; I < N; ++I)
+      Queues.push_back(std::make_unique<WorkQueue>());
+    for (unsigned I = 1; I < N; ++I)
+      Threads.emplace_back([this, I] { loop(I); });
+  }
+
+  ~Pool() {
+    {
+      std::lock_guard<std::mutex> L(M);
+      Stop = true;
+    }
+    Wake.notify_all();
+    for (std::thread &T : Threads)
+      T.join();
+  }
+
+  unsigned size() const { return Queues.size(); }
+
+  // L'intervallo [0, N) viene diviso in parti contigue, una per worker.
+  // I parziali vengono sommati nell'ordine dei worker, ma la suddivisione
+  // dipende dai furti: l'ordine delle somme non è deterministico
+  double run(kfe_parfor_body F, void *E, int64_t N) {
+    std::lock_guard<std::mutex> J(JobMutex);
+    unsigned T = Queues.size();
+    Body = F;
+    Env = E;
+    Grain = std::max<int64_t>(1, N / (int64_t(T) * 8));
+    Remaining.store(N, std::memory_order_relaxed);
+    Partial.assign(T, 0);
+    // Le prime N % T parti hanno un'iterazione in più; nessun prodotto con
+    // N, che per numeri di iterazioni grandi andrebbe in overflow
+    auto Start = [&](unsigned I) { return (N / T) * I + std::min<int64_t>(I, N % T); };
+    for (unsigned I = 0; I < T; ++I) {
+      Range R{Start(I), Start(I + 1)};
+      if (R.Lo < R.Hi)
+        Queues[I]->push(R);
+    }
+    {
+      std::lock_guard<std::mutex> L(M);
+      Busy = T - 1;
+      Generation++;
+    }
+    Wake.notify_all();
+    InWorker = true;
+    work(0);
+    InWorker = false;
+    {
+      std::unique_lock<std::mutex> L(M);
+      Done.wait(L, [&] { return Busy == 0; });
+    }
+    double Sum = 0;
+    for (double P : Partial)
+      Sum += P;
+    return Sum;
+  }
+};
+
+unsigned numThreads() {
+  if (const char *S = std::getenv("KFE_NUM_THREADS")) {
+    int N = std::atoi(S);
+    if (N > 0)
+      return N;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Creato al primo parfor, distrutto (con i thread) all'uscita del programma
+Pool &pool() {
+  static Pool P(numThreads());
+  return P;
+}
+
+} // namespace
+
+double kfe_parfor(kfe_parfor_body body, void *env, int64_t n) {
+  if (n <= 0)
+    return 0;
+  if (InWorker || n == 1)
+    return body(env, 0, n);
+  Pool &P = pool();
+  if (P.size() == 1)
+    return body(env, 0, n);
+  return P.run(body, env, n);
+}
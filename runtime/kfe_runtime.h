@@ -0,0 +1,23 @@
+#ifndef KFE_RUNTIME_H
+#define KFE_RUNTIME_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Corpo di un parfor estratto dal compilatore: esegue le iterazioni di
+// indice [lo, hi) e restituisce la somma dei valori del corpo
+typedef double (*kfe_parfor_body)(void *env, int64_t lo, int64_t hi);
+
+// Esegue n iterazioni del corpo in parallelo e restituisce la somma dei
+// valori delle iterazioni. I thread sono KFE_NUM_THREADS (default: uno per
+// core); un parfor annidato in un altro viene eseguito nel thread corrente
+double kfe_parfor(kfe_parfor_body body, void *env, int64_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,26 +4,32 @@
 # include <cstdlib>
 # include <string>
 # include <cmath>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
 # include "driver.hh"
 # include "parser.hh"
 
-// Work around an incompatibility in flex (at least versions
-// 2.5.31 through 2.5.33): it generates code that does
-// not conform to C89.  See Debian bug 333231
-// <http://bugs.debian.org/cgi-bin/bugreport.cgi?bug=333231>.
-# undef yywrap
-# define yywrap() 1
-
 // Pacify warnings in yy_init_buffer (observed with Flex 2.6.4)
 // and GCC 7.3.0.
 #if defined __GNUC__ && 7 <= __GNUC__
 # pragma GCC diagnostic ignored "-Wnull-dereference"
 #endif
 
-yy::parser::symbol_type check_keywords(std::string lexeme, yy::location& loc);
+yy::parser::symbol_type check_keywords(driver& drv, llvm::StringRef lexeme, yy::location& loc);
+
+// Gli errori lessicali vengono segnalati qui e restituiti come token di
+// errore (YYerror), che il parser tratta come un errore già segnalato: il
+// parser è compilato con -fno-exceptions e non potrebbe intercettarli
+static yy::parser::symbol_type scan_error (const yy::location& loc, const std::string& m)
+{
+  std::cerr << loc << ": " << m << '\n';
+  return yy::parser::make_YYerror (loc);
+}
 %}
 
-%option noyywrap nounput batch debug noinput
+%option noyywrap nounput batch debug noinput reentrant
 
 id      [a-zA-Z][a-zA-Z_0-9]*
 fpnum   [0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?
@@ -76,47 +82,133 @@ blank   [ \t]
 
 "while"  return yy::parser::make_WHILE     (loc);     // ********** Estensione 5 **********
 
+"parfor" return yy::parser::make_PARFOR    (loc);     // ********** Parfor **********
+
+"["      return yy::parser::make_LBRACKET  (loc);     // ********** Array **********
+"]"      return yy::parser::make_RBRACKET  (loc);
+
 
 {num}      {
   errno = 0;
   double n = strtod(yytext, NULL);
   if (! (n!=HUGE_VAL && n!=-HUGE_VAL && errno != ERANGE))
-    throw yy::parser::syntax_error (loc, "Float value is out of range: "
-                                    + std::string(yytext));
+    return scan_error (loc, "Float value is out of range: " + std::string(yytext));
   return yy::parser::make_NUMBER (n, loc);
 }
-{id}       return check_keywords(yytext, loc);
-.          {
-             throw yy::parser::syntax_error
-               (loc, "invalid character: " + std::string(yytext));
-}
+{id}       return check_keywords(drv, llvm::StringRef(yytext, yyleng), loc);
+.          return scan_error (loc, "invalid character: " + std::string(yytext));
 <<EOF>>    return yy::parser::make_END (loc);
 %%
 
-yy::parser::symbol_type check_keywords(std::string lexeme, yy::location& loc)  {
+// Gli identificatori vengono internati qui, una sola volta: al parser
+// arriva il puntatore al simbolo, non una copia del lessema
+yy::parser::symbol_type check_keywords(driver& drv, llvm::StringRef lexeme, yy::location& loc)  {
    if (lexeme == "def") {
      return yy::parser::make_DEF(loc);
    } else if (lexeme == "extern") {
      return yy::parser::make_EXTERN(loc);
    } else {
-     return yy::parser::make_IDENTIFIER (yytext, loc);
+     return yy::parser::make_IDENTIFIER (drv.symbols.intern(lexeme), loc);
    }
 }
 
-void driver::scan_begin ()
+// Lo scanner è rientrante: il suo stato è posseduto dal driver, così più
+// driver (e quindi più file) possono essere analizzati in parallelo.
+// Il sorgente viene letto direttamente in memoria (yy_scan_buffer):
+// - se il driver ha già il testo in memoria (parse_string) si usa quello;
+// - altrimenti il file viene mappato con mmap, senza copie. Flex richiede
+//   che il buffer termini con due caratteri nulli: se la dimensione del file
+//   lo consente si usano i byte a zero che seguono la fine del file
+//   nell'ultima pagina mappata, altrimenti il file viene letto in "buffer";
+// - con stdio_input (o leggendo da stdin) si usa il percorso di flex
+//   basato su FILE* (yyin), mantenuto per confronto.
+// Se il file non può essere aperto l'errore viene segnalato e restituisce
+// true: con -j gli altri file vengono compilati comunque
+bool driver::scan_begin ()
 {
-  yy_flex_debug = trace_scanning;
-  if (file.empty () || file == "-")
-    yyin = stdin;
-  else if (!(yyin = fopen (file.c_str (), "r")))
+  yylex_init (&scanner);
+  yyset_debug (trace_scanning, scanner);
+  if (in_memory) {
+    yy_scan_buffer (&buffer[0], buffer.size (), scanner);
+    return false;
+  }
+  if (file.empty () || file == "-" || stdio_input) {
+    FILE *in;
+    if (file.empty () || file == "-")
+      in = stdin;
+    else if (!(in = fopen (file.c_str (), "r")))
+      {
+        std::cerr << "cannot open " << file << ": " << strerror(errno) << '\n';
+        scan_end ();
+        return true;
+      }
+    yyset_in (in, scanner);
+    return false;
+  }
+  int fd = open (file.c_str (), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat (fd, &st) < 0)
     {
       std::cerr << "cannot open " << file << ": " << strerror(errno) << '\n';
-      exit (EXIT_FAILURE);
+      if (fd >= 0)
+        close (fd);
+      scan_end ();
+      return true;
+    }
+  size_t size = st.st_size;
+  size_t page = sysconf (_SC_PAGESIZE);
+  if (size > 0 && size % page != 0 && size % page <= page - 2) {
+    void *p = mmap (nullptr, size + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      mapped = static_cast<char*> (p);
+      mapped_size = size + 2;
+      close (fd);
+      yy_scan_buffer (mapped, mapped_size, scanner);
+      return false;
     }
+  }
+  buffer.resize (size + 2);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read (fd, &buffer[done], size - done);
+    if (n <= 0) break;
+    done += n;
+  }
+  buffer.resize (done);
+  buffer.append (2, '\0');
+  close (fd);
+  yy_scan_buffer (&buffer[0], buffer.size (), scanner);
+  return false;
 }
 
 void
 driver::scan_end ()
 {
-  fclose (yyin);
+  FILE *in = yyget_in (scanner);
+  if (in && in != stdin)
+    fclose (in);
+  yylex_destroy (scanner);
+  scanner = nullptr;
+  if (mapped) {
+    munmap (mapped, mapped_size);
+    mapped = nullptr;
+  }
+  buffer.clear ();
+}
+
+// Esegue la sola analisi lessicale del file, contando i token in tokens;
+// true se il file non può essere letto o contiene un errore lessicale
+bool driver::scan (const std::string &f, size_t &tokens)
+{
+  file = f;
+  location.initialize (&file);
+  tokens = 0;
+  if (scan_begin ())
+    return true;
+  yy::parser::symbol_kind_type kind;
+  while ((kind = yylex (*this).kind ()) != yy::parser::symbol_kind::S_YYEOF
+         && kind != yy::parser::symbol_kind::S_YYerror)
+    tokens++;
+  scan_end ();
+  return kind == yy::parser::symbol_kind::S_YYerror;
 }
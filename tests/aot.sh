@@ -0,0 +1,32 @@
+# Le stesse definizioni eseguite con --run e compilate in un oggetto
+# collegato a un main C devono dare gli stessi risultati
+KFE=$1
+T=$2
+cat > "$T/f.k" <<'K'
+def fib(n) if n < 2 then n else fib(n-1) + fib(n-2) end;
+def somma(n) var s = 0 in for i = 0, i < n in s = s + i * 0.5 end : s end;
+K
+cat "$T/f.k" > "$T/r.k"
+echo 'fib(20); somma(100);' >> "$T/r.k"
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+double fib(double);
+double somma(double);
+int main(void) {
+  printf("%g\n%g\n", fib(20), somma(100));
+  return 0;
+}
+C
+"$KFE" -O2 -o "$T/f" "$T/f.k" || exit 1
+${CC:-cc} -o "$T/a.out" "$T/main.c" "$T/f.o" || exit 1
+"$T/a.out" > "$T/aot.txt" || exit 1
+"$KFE" --run "$T/r.k" > "$T/jit.txt" || exit 1
+diff "$T/jit.txt" "$T/aot.txt" || exit 1
+"$KFE" "$T/f.k" -o 2> "$T/err" && exit 1
+grep -q "requires a file name" "$T/err" || exit 1
+
+# Con --run i moduli passano dalla pipeline di -O2 prima del JIT
+"$KFE" -O2 --run "$T/r.k" > "$T/jit2.txt" || exit 1
+diff "$T/jit.txt" "$T/jit2.txt" || exit 1
+"$KFE" -O2 -ftime-report --run "$T/r.k" 2> "$T/report" > /dev/null || exit 1
+grep -q ottimizzazione "$T/report"
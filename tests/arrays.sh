@@ -0,0 +1,9 @@
+# Le dimensioni degli array fuori dall'intervallo di un unsigned (o non
+# intere) sono errori di compilazione, non valori troncati
+KFE=$1
+T=$2
+for n in 1e20 5e9 0 2.5; do
+  echo "def f() var a[$n] in a[0] end;" > "$T/a.k"
+  "$KFE" -c -o "$T/a" "$T/a.k" 2> "$T/err" && exit 1
+  grep -q "deve essere un intero positivo" "$T/err" || exit 1
+done
@@ -0,0 +1,53 @@
+# --batch: f_batch(x..., out, n) calcola out[i] = f(x[i], ...) con gli
+# stessi risultati delle chiamate scalari; i prototipi sono nell'header
+KFE=$1
+T=$2
+cat > "$T/b.k" <<'K'
+def f(x y) x * y + 1;
+def g(x:int) if x < 3 then x * 2 else x / 2 end;
+def p(x) var s = 0 in for i = 0, i < x in s = s + i end : s end;
+def h(a:double* n:int) a[0];
+K
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+#include "b.h"
+#define N 1000
+int main(void) {
+  static double x[N], y[N], out[N];
+  static int64_t k[N];
+  int bad = 0;
+  for (int i = 0; i < N; i++) {
+    x[i] = i * 0.5 - 100;
+    y[i] = 3 - i * 0.25;
+    k[i] = i - 500;
+  }
+  f_batch(x, y, out, N);
+  for (int i = 0; i < N; i++)
+    bad += out[i] != f(x[i], y[i]);
+  g_batch(k, out, N);
+  for (int i = 0; i < N; i++)
+    bad += out[i] != g(k[i]);
+  p_batch(y, out, 20);
+  for (int i = 0; i < 20; i++)
+    bad += out[i] != p(y[i]);
+  printf("%d %g\n", bad, out[0]);
+  return 0;
+}
+C
+for o in -O0 -O2; do
+  "$KFE" $o --batch -emit-header -c -o "$T/b" "$T/b.k" || exit 1
+  grep -q '^void f_batch(const double \*x, const double \*y, double \*__restrict out, int64_t n);$' "$T/b.h" || exit 1
+  grep -q '^void g_batch(const int64_t \*x, double \*__restrict out, int64_t n);$' "$T/b.h" || exit 1
+  ! grep -q 'h_batch' "$T/b.h" || exit 1
+  ${CC:-cc} -o "$T/a.out" -I"$T" "$T/main.c" "$T/b.o" || exit 1
+  [ "$("$T/a.out")" = "0 3" ] || exit 1
+done
+
+# mustprogress solo se f termina: p contiene un loop e non è willreturn
+"$KFE" --batch -emit-llvm -o "$T/b" "$T/b.k" || exit 1
+attrs() {
+  G=$(sed -n "s/^define .*@$1(.*#\([0-9]*\) {\$/\1/p" "$T/b.ll")
+  grep "^attributes #$G " "$T/b.ll"
+}
+attrs f_batch | grep -q mustprogress || exit 1
+! attrs p_batch | grep -q mustprogress
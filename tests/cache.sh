@@ -0,0 +1,58 @@
+# Cache per funzione (--cache-dir): la seconda compilazione trova tutte le
+# definizioni, ogni opzione che cambia il codice invalida la chiave, più kfe
+# possono scrivere la stessa cache e la politica di pulizia viene applicata
+KFE=$1
+T=$2
+C=$T/cache
+cat > "$T/a.k" <<'K'
+def f(x) x * 2 + 1;
+def g(x) f(x) / 3;
+def h(n) var s = 0 in for i = 0, i < n in s = s + g(i) end : s end;
+K
+# conta "<hit> <miss>" [opzioni...]: compila a.k e controlla hit e miss
+conta() {
+  atteso=$1
+  shift
+  out=$("$KFE" "$@" --cache-dir="$C" -o "$T/a" "$T/a.k") || { echo "$*: errore"; return 1; }
+  got=$(echo "$out" | sed -n 's/.*: cache \([0-9]*\) hit, \([0-9]*\) miss$/\1 \2/p')
+  [ "$got" = "$atteso" ] || { echo "$*: '$got', atteso '$atteso'"; return 1; }
+}
+conta "0 3" -O2 || exit 1
+conta "3 0" -O2 || exit 1
+for o in -O1 -ffast-math -ffp-contract=fast -fno-simplify -mcpu=x86-64-v3 --batch \
+         -fprofile-generate; do
+  conta "0 3" -O2 $o || exit 1
+  conta "3 0" -O2 $o || exit 1
+done
+if [ "$(uname -m)" = x86_64 ]; then
+  conta "0 3" -O2 -mversions=x86-64-v3 || exit 1
+fi
+
+# Cambia solo il corpo di f: g e h (che dipendono dal suo prototipo) restano validi
+sed -i 's/x \* 2 + 1/x * 2 + 2/' "$T/a.k"
+conta "2 1" -O2 || exit 1
+
+# Due kfe in parallelo sulla stessa cache e due file con -j 2: nessun
+# conflitto, e alla compilazione successiva sono tutti hit
+rm -rf "$C"
+cp "$T/a.k" "$T/b.k"
+"$KFE" -O2 --cache-dir="$C" -o "$T/p1" "$T/a.k" > /dev/null &
+"$KFE" -O2 --cache-dir="$C" -o "$T/p2" "$T/a.k" > /dev/null &
+wait
+"$KFE" -O2 -j 2 --cache-dir="$C" "$T/a.k" "$T/b.k" > /dev/null || exit 1
+conta "3 0" -O2 || exit 1
+[ "$(ls "$C" | grep -c '^llvmcache-')" = 3 ] || exit 1
+cat > "$T/main.c" <<'M'
+#include <stdio.h>
+double h(double);
+int main(void) {
+  printf("%g\n", h(10));
+  return 0;
+}
+M
+${CC:-cc} -o "$T/a.out" "$T/main.c" "$T/a.a" || exit 1
+[ "$("$T/a.out")" = 36.6667 ] || exit 1
+
+# Pulizia immediata con al più un file
+conta "3 0" -O2 --cache-policy=prune_interval=0s:cache_size_files=1 || exit 1
+[ "$(ls "$C" | grep -c '^llvmcache-')" = 1 ]
@@ -0,0 +1,56 @@
+# Attributi dedotti dall'analisi degli effetti e --whole-program: ogni
+# funzione deve avere esattamente gli attributi dimostrati
+KFE=$1
+T=$2
+cat > "$T/e.k" <<'K'
+extern sin(x);
+def pura(x) x * x + 1;
+def leggi(a:double* i:int) a[i];
+def scrivi(a:double* i:int) a[i] = 1;
+def esterna(x) sin(x);
+def ciclo(n) var s = 0 in while s < n in s = s + 1 end : s end;
+def fib(n) if n < 2 then n else fib(n-1) + fib(n-2) end;
+def usa(x) pura(x) + pura(x + 1);
+def usaest(x) esterna(x) + 1;
+def locale(x) var a[4] in a[1] = x : a[1] end;
+def parallelo(a:double* n:int) parfor i:int = 0, n in a[i] = 1 end;
+K
+"$KFE" -emit-llvm -o "$T/e" "$T/e.k" || exit 1
+
+# Attributi (commento "; Function Attrs:") della definizione di $1
+attrs() {
+  awk -v f="@$1(" '
+    /^; Function Attrs:/ { a = substr($0, 19); next }
+    /^define/ { if (index($0, f)) { print a; exit } }
+    { a = "" }' "$T/e.ll"
+}
+fail=0
+check() {
+  got=$(attrs "$1")
+  if [ "$got" != "$2" ]; then
+    echo "$1: '$got', atteso '$2'"
+    fail=1
+  fi
+}
+check pura    "norecurse nounwind readnone willreturn"
+check leggi   "norecurse nounwind readonly willreturn"
+check scrivi  "norecurse nounwind willreturn"
+check esterna ""
+check ciclo   "norecurse nounwind readnone"
+check fib     "nounwind readnone"
+check usa     "norecurse nounwind readnone willreturn"
+check usaest  ""
+check locale  "norecurse nounwind readnone willreturn"
+check parallelo ""
+[ $fail = 0 ] || exit 1
+
+# Le funzioni non esportate diventano interne, quelle non raggiungibili
+# spariscono
+"$KFE" --whole-program --export=usa,usaest -emit-llvm -o "$T/w" "$T/e.k" || exit 1
+grep -q '^define internal fastcc double @pura(' "$T/w.ll" || exit 1
+grep -q '^define internal .*@esterna(' "$T/w.ll" || exit 1
+grep -q '^define double @usa(' "$T/w.ll" || exit 1
+grep -q '^define double @usaest(' "$T/w.ll" || exit 1
+! grep -Eq '@(leggi|scrivi|ciclo|fib|locale)\(' "$T/w.ll" || exit 1
+"$KFE" --export=usa -emit-llvm -o "$T/w" "$T/e.k" 2> "$T/err" && exit 1
+grep -q -- "--export requires --whole-program" "$T/err"
@@ -0,0 +1,30 @@
+# Flag fast-math e contrazione sulle istruzioni e sugli attributi delle
+# funzioni, per ogni combinazione di opzioni e per fastmath def
+KFE=$1
+T=$2
+cat > "$T/f.k" <<'K'
+def mad(a b c) a * b + c;
+fastmath def dot(a:double* b:double* n:int) var s = 0 in for i:int = 0, i < n in s = s + a[i]*b[i] end : s end;
+def div(x y) x / y;
+K
+fail=0
+# ir <opzioni> <regex che devono comparire>... ; "!regex" non deve comparire
+ir() {
+  o=$1
+  shift
+  "$KFE" $o -emit-llvm -o "$T/f" "$T/f.k" > /dev/null || { fail=1; return; }
+  for p in "$@"; do
+    case $p in
+      !*) grep -Eq -- "${p#!}" "$T/f.ll" && { echo "$o: presente $p"; fail=1; } ;;
+      *) grep -Eq -- "$p" "$T/f.ll" || { echo "$o: manca $p"; fail=1; } ;;
+    esac
+  done
+}
+ir "" 'fmul double %a' 'fadd double %mul' 'fdiv double' \
+   'fmul fast double %aelem' 'fadd fast double %s' '"unsafe-fp-math"="true"' '!fmuladd'
+ir "-ffast-math" 'fmul fast double %a' 'fadd fast double %mul' 'fdiv fast double'
+ir "-fassociative-math -fno-signed-zeros" 'fmul reassoc nsz double %a' 'fdiv reassoc nsz double'
+ir "-freciprocal-math -ffinite-math-only" 'fdiv nnan ninf arcp double'
+ir "-ffp-contract=on" 'call double @llvm\.fmuladd\.f64\(double %a' '!fmul double %a'
+ir "-ffp-contract=fast" 'fmul contract double %a' 'fadd contract double %mul'
+[ $fail = 0 ]
@@ -0,0 +1,41 @@
+# -emit-header: i prototipi generati compilano in C e in C++ e corrispondono
+# alle funzioni dell'oggetto; -flto=thin scrive il bitcode con il riassunto
+# del modulo per la ThinLTO
+KFE=$1
+T=$2
+cat > "$T/h.k" <<'K'
+def somma(a:double* n:int) var s = 0 in for i:int = 0, i < n in s = s + a[i] end : s end;
+def scala(a:double* n:int k) for i:int = 0, i < n in a[i] = a[i] * k end;
+def conta(v:int* n:int soglia:int) var c:int in for i:int = 0, i < n in c = c + (v[i] > soglia) end : c end;
+def media(x y) (x + y) / 2;
+def costante() 42;
+K
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+#include "h.h"
+int main(void) {
+  double a[4] = {1, 2, 3, 4};
+  int64_t v[5] = {1, 5, 2, 7, 9};
+  scala(a, 4, 2);
+  printf("%g %g %g %g\n", somma(a, 4), conta(v, 5, 4), media(1, 2), costante());
+  return 0;
+}
+C
+"$KFE" -O2 -emit-header -c -o "$T/h" "$T/h.k" || exit 1
+grep -q '^double somma(double \*__restrict a, int64_t n);$' "$T/h.h" || exit 1
+grep -q '^double scala(double \*__restrict a, int64_t n, double k);$' "$T/h.h" || exit 1
+grep -q '^double conta(int64_t \*__restrict v, int64_t n, int64_t soglia);$' "$T/h.h" || exit 1
+grep -q '^double media(double x, double y);$' "$T/h.h" || exit 1
+grep -q '^double costante(void);$' "$T/h.h" || exit 1
+${CC:-cc} -Wall -Werror -o "$T/a.out" -I"$T" "$T/main.c" "$T/h.o" || exit 1
+[ "$("$T/a.out")" = "20 3 1.5 42" ] || exit 1
+cp "$T/main.c" "$T/main.cc"
+${CXX:-c++} -Wall -Werror -o "$T/b.out" -I"$T" "$T/main.cc" "$T/h.o" || exit 1
+[ "$("$T/b.out")" = "20 3 1.5 42" ] || exit 1
+
+# Il riassunto per la ThinLTO (^0 = module: ...) c'è solo con -flto=thin
+BIN=$(llvm-config-14 --bindir 2> /dev/null) || exit 0
+"$KFE" -O2 -flto=thin -o "$T/thin" "$T/h.k" || exit 1
+"$BIN/llvm-dis" -o - "$T/thin.bc" | grep -q '^\^0 = module:' || exit 1
+"$KFE" -O2 -flto -o "$T/full" "$T/h.k" || exit 1
+! "$BIN/llvm-dis" -o - "$T/full.bc" | grep -q '^\^0 = module:'
@@ -0,0 +1,11 @@
+# I parametri delle annotazioni fuori dall'intervallo di un unsigned (o non
+# interi) sono errori di compilazione, non valori troncati
+KFE=$1
+T=$2
+for h in 'unroll(1e20)' 'vectorize(5e9)' 'interleave(0)' 'unroll(2.5)'; do
+  echo "def f(n) var s = 0 in for i = 0, i < n $h in s = s + i end : s end;" > "$T/h.k"
+  "$KFE" -c -o "$T/h" "$T/h.k" 2> "$T/err" && exit 1
+  grep -q "deve essere un intero positivo" "$T/err" || exit 1
+done
+echo 'def f(n) var s = 0 in for i = 0, i < n unroll(4294967295) in s = s + i end : s end;' > "$T/h.k"
+"$KFE" -c -o "$T/h" "$T/h.k"
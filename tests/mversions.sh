@@ -0,0 +1,35 @@
+# -mversions: ifunc con una versione per CPU e un resolver che controlla
+# tutte le feature richieste; le CPU non verificabili vengono rifiutate
+KFE=$1
+T=$2
+[ "$(uname -m)" = x86_64 ] || exit 0
+cat > "$T/m.k" <<'K'
+def dot(a:double* b:double* n:int) var s = 0 in for i:int = 0, i < n in s = s + a[i]*b[i] end : s end;
+K
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+#include <stdint.h>
+double dot(double *, double *, int64_t);
+int main(void) {
+  double a[100], b[100];
+  for (int i = 0; i < 100; i++) {
+    a[i] = i;
+    b[i] = 2;
+  }
+  printf("%g\n", dot(a, b, 100));
+  return 0;
+}
+C
+"$KFE" -O2 -mversions=x86-64-v2,x86-64-v3,x86-64-v4 -emit-llvm -c -o "$T/m" "$T/m.k" || exit 1
+grep -q '^@dot = ifunc' "$T/m.ll" || exit 1
+for v in default x86-64-v2 x86-64-v3 x86-64-v4; do
+  grep -q "^define internal double @dot\.$v(" "$T/m.ll" || exit 1
+done
+grep -q 'cpuid' "$T/m.ll" || exit 1
+${CC:-cc} -o "$T/a.out" "$T/main.c" "$T/m.o" || exit 1
+[ "$("$T/a.out")" = 9900 ] || exit 1
+
+"$KFE" -mversions=sapphirerapids -c -o "$T/m" "$T/m.k" 2> "$T/err" && exit 1
+grep -q "cannot be checked at load time" "$T/err" || exit 1
+"$KFE" -mversions=nessuna -c -o "$T/m" "$T/m.k" 2> "$T/err" && exit 1
+grep -q "unsupported CPU" "$T/err"
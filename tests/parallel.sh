@@ -0,0 +1,37 @@
+# Con -j N ogni sorgente viene compilato nel proprio oggetto, identico a
+# quello della compilazione sequenziale; un file con errori non blocca gli
+# altri ma fa fallire kfe
+KFE=$1
+T=$2
+echo 'def fa(x) x + 1;' > "$T/a.k"
+echo 'extern fa(x); def fb(x) fa(x) * 2;' > "$T/b.k"
+echo 'extern fb(x); def fc(x) for i = 0, i < 3 in x = fb(x) end : x;' > "$T/c.k"
+echo 'def fd(x) if x < 0 then -x else x end;' > "$T/d.k"
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+double fc(double);
+double fd(double);
+int main(void) {
+  printf("%g %g\n", fc(1), fd(-5));
+  return 0;
+}
+C
+"$KFE" -O2 -j 1 "$T/a.k" "$T/b.k" "$T/c.k" "$T/d.k" || exit 1
+for f in a b c d; do mv "$T/$f.o" "$T/$f.seq.o"; done
+"$KFE" -O2 -j 4 "$T/a.k" "$T/b.k" "$T/c.k" "$T/d.k" || exit 1
+for f in a b c d; do cmp "$T/$f.o" "$T/$f.seq.o" || exit 1; done
+${CC:-cc} -o "$T/a.out" "$T/main.c" "$T/a.o" "$T/b.o" "$T/c.o" "$T/d.o" || exit 1
+[ "$("$T/a.out")" = "22 5" ] || exit 1
+
+rm -f "$T"/*.o
+echo 'def fe(x) x - ;' > "$T/e.k"
+"$KFE" -j 2 "$T/a.k" "$T/e.k" "$T/d.k" && exit 1
+[ -f "$T/a.o" ] && [ -f "$T/d.o" ] && [ ! -f "$T/e.o" ] || exit 1
+
+# Un file illeggibile è un errore del suo job, come un errore di sintassi
+rm -f "$T"/*.o
+"$KFE" -j 2 "$T/a.k" "$T/manca.k" "$T/d.k" 2> "$T/err" && exit 1
+grep -q "cannot open" "$T/err" || exit 1
+[ -f "$T/a.o" ] && [ -f "$T/d.o" ] || exit 1
+"$KFE" "$T/a.k" -j 2> "$T/err" && exit 1
+grep -q "requires a number of jobs" "$T/err"
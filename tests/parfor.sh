@@ -0,0 +1,55 @@
+# I risultati dei parfor non dipendono dal numero di thread del runtime;
+# un programma compilato viene collegato a runtime/libkfe_rt.a
+KFE=$1
+T=$2
+DIR=$(dirname "$0")
+for n in 1 4; do
+  KFE_NUM_THREADS=$n "$KFE" --run "$DIR/parfor.k" > "$T/out" 2> /dev/null
+  diff "$DIR/parfor.out" "$T/out" || { echo "KFE_NUM_THREADS=$n"; exit 1; }
+done
+
+cat > "$T/v.k" <<'K'
+def norma2(a:double* n:int) parfor i:int = 0, n in a[i] * a[i] end;
+def scala(a:double* n:int k) parfor i:int = 0, n in a[i] = a[i] * k end;
+K
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+#include <stdint.h>
+double norma2(double *, int64_t);
+double scala(double *, int64_t, double);
+int main(void) {
+  double a[1000];
+  for (int i = 0; i < 1000; i++)
+    a[i] = i % 10;
+  scala(a, 1000, 2);
+  printf("%g\n", norma2(a, 1000));
+  return 0;
+}
+C
+"$KFE" -O2 -o "$T/v" "$T/v.k" || exit 1
+${CXX:-c++} -o "$T/a.out" -x c "$T/main.c" -x none "$T/v.o" "$DIR/../runtime/libkfe_rt.a" -pthread || exit 1
+[ "$(KFE_NUM_THREADS=4 "$T/a.out")" = 114000 ] || exit 1
+
+# Suddivisione di un numero di iterazioni vicino a INT64_MAX: le parti
+# coprono [0, n) esattamente una volta, senza overflow nei loro estremi
+cat > "$T/big.cc" <<'C'
+#include <stdio.h>
+#include <stdint.h>
+#include "kfe_runtime.h"
+static int64_t total, bad;
+static const int64_t n = INT64_MAX - 5;
+static double body(void *env, int64_t lo, int64_t hi) {
+  if (lo < 0 || hi > n || lo >= hi)
+    __atomic_fetch_add(&bad, 1, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_add(&total, hi - lo, __ATOMIC_RELAXED);
+  return 0;
+}
+int main(void) {
+  kfe_parfor(body, 0, n);
+  printf("%d\n", bad == 0 && total == n);
+  return 0;
+}
+C
+${CXX:-c++} -o "$T/big" -I"$DIR/../runtime" "$T/big.cc" "$DIR/../runtime/libkfe_rt.a" -pthread || exit 1
+[ "$(KFE_NUM_THREADS=3 "$T/big")" = 1 ]
@@ -0,0 +1,58 @@
+# PGO: -fprofile-generate strumenta il codice, il profilo indicizzato
+# prodotto da llvm-profdata diventa metadati !prof con -fprofile-use e i
+# profili mancanti o non validi sono un errore. Se è disponibile clang (con
+# il runtime di profiling di compiler-rt) il profilo viene prodotto
+# eseguendo il programma; altrimenti viene scritto in formato testuale con
+# gli hash delle funzioni strumentate
+KFE=$1
+T=$2
+BIN=$(llvm-config-14 --bindir 2> /dev/null) || exit 0
+cat > "$T/p.k" <<'K'
+def f(x) if x < 10 then x * 2 else x / 2 end;
+def g(n) var s = 0 in for i = 0, i < n in s = s + f(i) end : s end;
+K
+"$KFE" -O2 -fprofile-generate -emit-llvm -c -o "$T/p" "$T/p.k" || exit 1
+grep -q '^@__profc_f = ' "$T/p.ll" || exit 1
+grep -q '^@__profc_g = ' "$T/p.ll" || exit 1
+! grep -q 'readnone' "$T/p.ll" || exit 1
+
+cat > "$T/main.c" <<'C'
+#include <stdio.h>
+double g(double);
+int main(void) {
+  printf("%g\n", g(1000));
+  return 0;
+}
+C
+if command -v clang > /dev/null &&
+   clang -fprofile-generate -o "$T/a.out" "$T/main.c" "$T/p.o" 2> /dev/null; then
+  LLVM_PROFILE_FILE="$T/p.profraw" "$T/a.out" > /dev/null || exit 1
+  "$BIN/llvm-profdata" merge -o "$T/p.profdata" "$T/p.profraw" || exit 1
+else
+  hash() {
+    sed -n "s/^@__profd_$1 = .*{ i64 -\{0,1\}[0-9]*, i64 \(-\{0,1\}[0-9]*\),.*/\1/p" "$T/p.ll"
+  }
+  printf '# IR level Instrumentation Flag\n:ir\nf\n%s\n2\n10\n990\n\ng\n%s\n3\n1\n1000\n1\n' \
+    "$(hash f)" "$(hash g)" > "$T/p.proftext"
+  "$BIN/llvm-profdata" merge -o "$T/p.profdata" "$T/p.proftext" || exit 1
+fi
+"$KFE" -O2 -fprofile-use="$T/p.profdata" -emit-llvm -o "$T/u" "$T/p.k" 2> "$T/err" || exit 1
+grep -q 'hash mismatch' "$T/err" && exit 1
+grep -q '^define double @f(.*!prof ' "$T/u.ll" || exit 1
+grep -q '^define double @g(.*!prof ' "$T/u.ll" || exit 1
+grep -q '"function_entry_count"' "$T/u.ll" || exit 1
+grep -q '"branch_weights"' "$T/u.ll" || exit 1
+
+# Una funzione con il controllo di flusso cambiato viene segnalata
+sed 's/if x < 10 then x \* 2/if x < 10 then if x < 5 then 1 else x * 2 end/' "$T/p.k" > "$T/q.k"
+"$KFE" -O2 -fprofile-use="$T/p.profdata" -emit-llvm -o "$T/q" "$T/q.k" 2> "$T/err" || exit 1
+grep -q 'hash mismatch) f' "$T/err" || exit 1
+
+# Profilo mancante, non indicizzato o insieme a -fprofile-generate
+"$KFE" -fprofile-use="$T/nessuno.profdata" -o "$T/u" "$T/p.k" 2> "$T/err" && exit 1
+grep -q "^-fprofile-use: .*nessuno.profdata: " "$T/err" || exit 1
+"$KFE" -fprofile-use="$T/p.k" -o "$T/u" "$T/p.k" 2> "$T/err" && exit 1
+grep -q "^-fprofile-use: " "$T/err" || exit 1
+"$KFE" -fprofile-generate -fprofile-use="$T/p.profdata" -o "$T/u" "$T/p.k" 2> /dev/null && exit 1
+"$KFE" -fprofile-generate --run "$T/p.k" 2> /dev/null && exit 1
+exit 0
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Test di regressione (make check). Per ogni tests/<nome>.k:
+#   <nome>.flags  opzioni di kfe, una combinazione per riga (default: nessuna);
+#                 il test viene ripetuto per ciascuna
+#   <nome>.out    output atteso (stdout) di kfe --run; gli errori di
+#                 compilazione vanno su stderr e non vengono confrontati
+#   <nome>.ir     righe "+regex" che devono comparire nell'IR prodotto con
+#                 -emit-llvm e righe "-regex" che non devono comparire
+# Gli script tests/<nome>.sh coprono i casi che non si riducono a un singolo
+# sorgente: ricevono kfe e una directory temporanea e falliscono con exit != 0.
+#   tests/run.sh [kfe]
+DIR=$(dirname "$0")
+KFE=${1:-${KFE:-$DIR/../kfe}}
+TMP=${TMPDIR:-/tmp}/kcheck.$$
+mkdir -p "$TMP"
+pass=0
+fail=0
+
+ok() { pass=$((pass + 1)); }
+ko() { fail=$((fail + 1)); echo "FAIL: $1"; }
+
+# Righe di <nome>.flags (una riga vuota se il file non esiste)
+flags() {
+  if [ -f "$1" ]; then cat "$1"; else echo; fi
+}
+
+for k in "$DIR"/*.k; do
+  t=${k%.k}
+  n=$(basename "$t")
+  while IFS= read -r f; do
+    if [ -f "$t.out" ]; then
+      "$KFE" $f --run "$k" < /dev/null > "$TMP/$n.run" 2> "$TMP/$n.err"
+      if cmp -s "$t.out" "$TMP/$n.run"; then
+        ok
+      else
+        ko "$n.k --run $f"
+        diff "$t.out" "$TMP/$n.run" | head -n 10
+        head -n 5 "$TMP/$n.err"
+      fi
+    fi
+    if [ -f "$t.ir" ]; then
+      rm -f "$TMP/$n.ll"
+      if ! "$KFE" $f -emit-llvm -o "$TMP/$n" "$k" < /dev/null > /dev/null 2> "$TMP/$n.err"; then
+        ko "$n.k -emit-llvm $f"
+        head -n 5 "$TMP/$n.err"
+        continue
+      fi
+      good=1
+      while IFS= read -r p; do
+        re=${p#?}
+        case $p in
+          +*) grep -Eq -- "$re" "$TMP/$n.ll" || { good=0; echo "  manca: $re"; } ;;
+          -*) grep -Eq -- "$re" "$TMP/$n.ll" && { good=0; echo "  presente: $re"; } ;;
+        esac
+      done < "$t.ir"
+      if [ $good = 1 ]; then ok; else ko "$n.k -emit-llvm $f"; fi
+    fi
+  done <<EOF
+$(flags "$t.flags")
+EOF
+done
+
+for s in "$DIR"/*.sh; do
+  n=$(basename "$s" .sh)
+  [ "$n" = run ] && continue
+  mkdir -p "$TMP/$n"
+  if sh "$s" "$KFE" "$TMP/$n" < /dev/null > "$TMP/$n.log" 2>&1; then
+    ok
+  else
+    ko "$n.sh"
+    tail -n 10 "$TMP/$n.log"
+  fi
+done
+
+rm -rf "$TMP"
+echo "$pass test superati, $fail falliti"
+[ $fail = 0 ]
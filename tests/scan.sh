@@ -0,0 +1,15 @@
+# Un carattere non valido è un errore segnalato con la sua posizione, sia
+# con --scan-only (mmap e stdio) sia nella compilazione, senza terminare kfe
+KFE=$1
+T=$2
+echo 'def f(x) x + 1;' > "$T/ok.k"
+printf 'def f(x) x + 1;\ndef g(x) x $ 2;\n' > "$T/bad.k"
+for o in "" --stdio-input; do
+  "$KFE" --scan-only $o "$T/ok.k" > /dev/null || exit 1
+  "$KFE" --scan-only $o "$T/bad.k" > /dev/null 2> "$T/err"
+  [ $? = 1 ] || exit 1
+  grep -q 'bad.k:2.*invalid character: \$' "$T/err" || exit 1
+done
+"$KFE" -c -o "$T/bad" "$T/bad.k" 2> "$T/err"
+[ $? = 1 ] || exit 1
+grep -q 'invalid character: \$' "$T/err"